@@ -0,0 +1,134 @@
+// Прошивка для цикловых замеров в симуляторе AVR (env:avrbench).
+// Запускается вместо основного цикла: ядро Arduino вызывает initVariant()
+// перед setup(), здесь мы сами выполняем setup(), прогоняем замеры и
+// останавливаем процессор. Такты считает bench/simavr_bench.cpp по
+// записям в GPIOR0. Запуск: bench/run.sh
+#include <Arduino.h>
+#include <avr/sleep.h>
+#include <OneWire.h>
+#include <DallasTemperature.h>
+
+#include "thermostat.h"
+#include "bench_ids.h"
+#include "crc_variants.h"
+
+// Сколько раз повторять каждый замер.
+#define BENCH_REPEAT (8)
+// Символов на дисплее 1602.
+#define SCREEN_CHARS (2 * 16)
+
+#define BENCH_BEGIN(id) (GPIOR0 = (id))
+#define BENCH_END() (GPIOR0 = BENCH_NONE)
+
+extern "C" void TIMER1_COMPA_vect(void);
+extern "C" void PCINT1_vect(void);
+
+// Блокнот DS18B20 с температурой 45.5 °C и корректным CRC.
+static uint8_t scratchpad[9] = { 0xD8, 0x02, 0x4B, 0x46, 0x7F, 0xFF, 0x08, 0x10, 0x00 };
+static const uint8_t rom[8] = { 0x28, 0x01, 0xEF, 0xBE, 0xAD, 0xDE, 0x00, 0x00 };
+
+// Результаты пишутся в volatile, чтобы компилятор не выбросил вызовы.
+static volatile uint8_t sink_u8;
+static volatile uint16_t sink_u16;
+static volatile int16_t sink_i16;
+static volatile float sink_float;
+
+void initVariant(void)
+{
+    scratchpad[8] = OneWire::crc8(scratchpad, 8);
+
+    // Самопроверки в этой сборке нет (SKIP_SELF_TEST): замеры идут не в
+    // состоянии паники.
+    setup();
+    // Таймер секунд и PCINT больше не нужны: их прерывания искажали бы замеры.
+    TIMSK1 = 0;
+    PCICR = 0;
+
+    filament = &filaments[0];
+    heating_stage = Working;
+    seconds = 1234;
+
+    DallasTemperature decoder;
+
+    for (uint8_t i = 0; i < BENCH_REPEAT; i++) {
+        BENCH_BEGIN(BENCH_EMPTY);
+        BENCH_END();
+
+        BENCH_BEGIN(BENCH_CRC8);
+        sink_u8 = OneWire::crc8(scratchpad, 9);
+        BENCH_END();
+
+        BENCH_BEGIN(BENCH_CRC8_BITWISE);
+        sink_u8 = crc8_bitwise(scratchpad, 9);
+        BENCH_END();
+
+        BENCH_BEGIN(BENCH_CRC8_NIBBLE);
+        sink_u8 = crc8_nibble(scratchpad, 9);
+        BENCH_END();
+
+        BENCH_BEGIN(BENCH_CRC8_TABLE_FLASH);
+        sink_u8 = crc8_table_flash(scratchpad, 9);
+        BENCH_END();
+
+        BENCH_BEGIN(BENCH_CRC8_TABLE_RAM);
+        sink_u8 = crc8_table_ram(scratchpad, 9);
+        BENCH_END();
+
+        BENCH_BEGIN(BENCH_CRC16);
+        sink_u16 = OneWire::crc16(scratchpad, 9);
+        BENCH_END();
+
+        BENCH_BEGIN(BENCH_RAW_TO_CELSIUS);
+        sink_float = DallasTemperature::rawToCelsius(5824 + i);
+        BENCH_END();
+
+        BENCH_BEGIN(BENCH_CALCULATE_TEMPERATURE);
+        sink_i16 = decoder.calculateTemperature(rom, scratchpad);
+        BENCH_END();
+
+        // Экран очищается перед каждым замером, чтобы переносить на
+        // дисплей было что: весь кадр или, за проход run_bus(), его часть.
+        clear_screen();
+        BENCH_BEGIN(BENCH_UPDATE_SCREEN);
+        update_screen(45 + i);
+        BENCH_END();
+
+        BENCH_BEGIN(BENCH_FLUSH_FRAME);
+        flush_frame(SCREEN_CHARS);
+        BENCH_END();
+
+        clear_screen();
+        update_screen(45 + i);
+        BENCH_BEGIN(BENCH_RUN_BUS);
+        run_bus();
+        BENCH_END();
+
+        BENCH_BEGIN(BENCH_QUERY_SENSOR);
+        sink_u8 = query_sensor();
+        BENCH_END();
+
+        BENCH_BEGIN(BENCH_FILTER_TEMPERATURE);
+        sink_i16 = filter_temperature(5824 + (i & 1) * 16);
+        BENCH_END();
+
+        BENCH_BEGIN(BENCH_UPDATE_OBSERVER);
+        update_observer(5824 + (i & 1) * 16, i & 1);
+        BENCH_END();
+
+        // Обработчики прерываний вызываются как функции: вход в прерывание
+        // стоит на пару тактов больше, чем call.
+        BENCH_BEGIN(BENCH_ISR_TIMER1);
+        TIMER1_COMPA_vect();
+        BENCH_END();
+
+        BENCH_BEGIN(BENCH_ISR_PCINT1);
+        PCINT1_vect();
+        BENCH_END();
+    }
+
+    // Сон с запрещёнными прерываниями simavr считает концом программы.
+    cli();
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    sleep_enable();
+    sleep_cpu();
+}
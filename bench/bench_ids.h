@@ -0,0 +1,42 @@
+/*
+ * Номера замеров, которые прошивка стенда пишет в GPIOR0.
+ * Общий файл для bench/avr_bench.cpp (AVR) и bench/simavr_bench.cpp (хост).
+ * Запись номера - начало замера, запись нуля - конец.
+ */
+#ifndef BENCH_IDS_H
+#define BENCH_IDS_H
+
+enum BenchId
+{
+    BENCH_NONE,
+    BENCH_EMPTY, // Пустой замер: накладные расходы самих меток.
+    BENCH_CRC8,
+    BENCH_CRC8_BITWISE,
+    BENCH_CRC8_NIBBLE,
+    BENCH_CRC8_TABLE_FLASH,
+    BENCH_CRC8_TABLE_RAM,
+    BENCH_CRC16,
+    BENCH_RAW_TO_CELSIUS,
+    BENCH_CALCULATE_TEMPERATURE,
+    BENCH_UPDATE_SCREEN, // Только отрисовка в кадр в RAM.
+    BENCH_FLUSH_FRAME, // Перенос всего кадра на дисплей.
+    BENCH_RUN_BUS, // Один проход шины I2C: FRAME_SLOT_CHARS символов.
+    BENCH_QUERY_SENSOR,
+    BENCH_FILTER_TEMPERATURE,
+    BENCH_UPDATE_OBSERVER,
+    BENCH_ISR_TIMER1,
+    BENCH_ISR_PCINT1,
+    BENCH_COUNT,
+};
+
+#define BENCH_NAMES \
+    { \
+        "", "empty", "OneWire::crc8 (9 bytes)", "  crc8 bitwise (table=0)", "  crc8 nibble (table=1)", \
+            "  crc8 flash 256 (table=2)", "  crc8 RAM 256 (table=3)", "OneWire::crc16 (9 bytes)", \
+            "rawToCelsius", "calculateTemperature", \
+            "update_screen (to frame)", "flush_frame (whole frame)", "run_bus (one pass)", \
+            "query_sensor", "filter_temperature", "update_observer", \
+            "ISR(TIMER1_COMPA_vect)", "ISR(PCINT1_vect)", \
+    }
+
+#endif /* BENCH_IDS_H */
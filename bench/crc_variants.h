@@ -0,0 +1,85 @@
+/*
+ * Все варианты CRC-8 Dallas из OneWire (ONEWIRE_CRC8_TABLE = 0..3) в одном
+ * месте, чтобы сравнивать их в одной сборке: такты на AVR
+ * (bench/avr_bench.cpp), скорость и эквивалентность на хосте (--crc-bench).
+ * Таблицы общие с OneWire.cpp: lib/OneWire/util/OneWire_crc8_table.h.
+ */
+#ifndef BENCH_CRC_VARIANTS_H
+#define BENCH_CRC_VARIANTS_H
+
+#include <stdint.h>
+
+#include <Arduino.h>
+#if defined(__AVR__)
+#include <util/crc16.h>
+#endif
+#include <util/OneWire_crc8_table.h>
+
+static const uint8_t PROGMEM crc8_nibble_table[] = ONEWIRE_DSCRC2X16_TABLE;
+static const uint8_t PROGMEM crc8_flash_table[] = ONEWIRE_DSCRC_TABLE;
+static const uint8_t crc8_ram_table[] = ONEWIRE_DSCRC_TABLE;
+
+// ONEWIRE_CRC8_TABLE = 0.
+static inline uint8_t crc8_bitwise(const uint8_t *data, uint8_t len)
+{
+    uint8_t crc = 0;
+    while (len--) {
+#if defined(__AVR__)
+        crc = _crc_ibutton_update(crc, *data++);
+#else
+        uint8_t byte = *data++;
+        for (uint8_t i = 8; i; i--) {
+            const uint8_t mix = (crc ^ byte) & 0x01;
+            crc >>= 1;
+            if (mix)
+                crc ^= 0x8C;
+            byte >>= 1;
+        }
+#endif
+    }
+    return crc;
+}
+
+// ONEWIRE_CRC8_TABLE = 1.
+static inline uint8_t crc8_nibble(const uint8_t *data, uint8_t len)
+{
+    uint8_t crc = 0;
+    while (len--) {
+        crc ^= *data++;
+        crc = pgm_read_byte(crc8_nibble_table + (crc & 0x0F))
+            ^ pgm_read_byte(crc8_nibble_table + 16 + (crc >> 4));
+    }
+    return crc;
+}
+
+// ONEWIRE_CRC8_TABLE = 2.
+static inline uint8_t crc8_table_flash(const uint8_t *data, uint8_t len)
+{
+    uint8_t crc = 0;
+    while (len--)
+        crc = pgm_read_byte(crc8_flash_table + (crc ^ *data++));
+    return crc;
+}
+
+// ONEWIRE_CRC8_TABLE = 3.
+static inline uint8_t crc8_table_ram(const uint8_t *data, uint8_t len)
+{
+    uint8_t crc = 0;
+    while (len--)
+        crc = crc8_ram_table[crc ^ *data++];
+    return crc;
+}
+
+// CRC-16 1-Wire (полином 0xA001, отражённый) по определению, бит за битом.
+// Эталон для проверки OneWire::crc16.
+static inline uint16_t crc16_reference(const uint8_t *data, uint16_t len, uint16_t crc)
+{
+    while (len--) {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++)
+            crc = crc & 0x01 ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+    return crc;
+}
+
+#endif /* BENCH_CRC_VARIANTS_H */
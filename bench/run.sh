@@ -0,0 +1,24 @@
+#!/bin/sh
+# Цикловые замеры прошивки в simavr и размеры прошивки.
+# Нужны PlatformIO, simavr (заголовки и libsimavr) и libelf.
+set -e
+
+cd "$(dirname "$0")/.."
+
+pio run -e avrbench
+pio run -e nanoatmega328 -t size
+
+# Цена каждого варианта CRC-8 из OneWire во флеше и ОЗУ.
+for table in 0 1 2 3; do
+    echo "ONEWIRE_CRC8_TABLE=$table:"
+    PLATFORMIO_BUILD_FLAGS="-D ONEWIRE_CRC8_TABLE=$table" \
+        pio run -s -e nanoatmega328 -t size | grep -E '^(RAM|Flash):'
+done
+
+mkdir -p .pio/bench
+c++ -O2 -std=c++11 -Ilib/ArduinoHost -Isim -Ibench \
+    -o .pio/bench/simavr_bench bench/simavr_bench.cpp sim/ds18b20.cpp \
+    $(pkg-config --cflags --libs simavr 2>/dev/null || echo -lsimavr -lelf)
+
+echo
+.pio/bench/simavr_bench .pio/build/avrbench/firmware.elf
@@ -0,0 +1,185 @@
+// Хостовая часть цикловых замеров: загружает прошивку env:avrbench в
+// simavr (ATmega328P, 16 МГц), подключает заглушки дисплея и термодатчика
+// и считает такты между метками в GPIOR0 (см. bench_ids.h).
+//
+// Дисплей - ведомое I2C по адресу 0x27, подтверждающее все байты.
+// Термодатчик - модель DS18B20 из sim/ds18b20.cpp на пине D2, линия
+// опрашивается каждую микросекунду.
+//
+// Сборка и запуск: bench/run.sh
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_twi.h>
+
+#include "ds18b20.h"
+#include "bench_ids.h"
+
+#define MCU_NAME "atmega328p"
+#define MCU_FREQUENCY (16000000)
+// Адреса регистров в пространстве данных ATmega328P.
+#define REG_GPIOR0 (0x3E)
+#define REG_DDRD (0x2A)
+#define REG_PORTD (0x2B)
+// Пин термодатчика: D2 = PD2.
+#define SENSOR_BIT (2)
+// Адрес дисплея на шине I2C.
+#define LCD_ADDRESS (0x27)
+// Период опроса линии 1-wire, такты (1 мкс).
+#define ONEWIRE_POLL_CYCLES (MCU_FREQUENCY / 1000000)
+
+struct BenchStats
+{
+    unsigned long count;
+    avr_cycle_count_t total;
+    avr_cycle_count_t min;
+    avr_cycle_count_t max;
+};
+
+static BenchStats stats[BENCH_COUNT];
+static uint8_t current_id = BENCH_NONE;
+static avr_cycle_count_t started_at = 0;
+
+static Ds18b20 probe(0x0000DEADBEEF01ULL);
+static avr_irq_t *sensor_irq = NULL;
+static bool master_low = false;
+static int line_level = -1;
+
+static avr_irq_t *lcd_irq = NULL;
+static uint8_t lcd_selected = 0;
+
+static void on_gpior0_write(avr_t *avr, avr_io_addr_t addr, uint8_t value, void *param)
+{
+    (void) param;
+    avr->data[addr] = value;
+
+    if (current_id != BENCH_NONE && current_id < BENCH_COUNT) {
+        const avr_cycle_count_t cycles = avr->cycle - started_at;
+        BenchStats &s = stats[current_id];
+        if (s.count == 0 || cycles < s.min)
+            s.min = cycles;
+        if (cycles > s.max)
+            s.max = cycles;
+        s.total += cycles;
+        s.count++;
+    }
+    current_id = value;
+    started_at = avr->cycle;
+}
+
+// Линия 1-wire: мастер тянет её к земле, когда пин - выход с нулём.
+static avr_cycle_count_t poll_onewire(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+    (void) param;
+    const uint64_t now_us = avr->cycle / (MCU_FREQUENCY / 1000000);
+    const uint8_t mask = 1 << SENSOR_BIT;
+    const bool low = (avr->data[REG_DDRD] & mask) && !(avr->data[REG_PORTD] & mask);
+
+    if (low != master_low) {
+        master_low = low;
+        probe.master_changed(low, now_us);
+    }
+
+    const int level = !low && !probe.pulls_low(now_us);
+    if (level != line_level) {
+        line_level = level;
+        avr_raise_irq(sensor_irq, level);
+    }
+    return when + ONEWIRE_POLL_CYCLES;
+}
+
+// Ведомое I2C, подтверждающее адрес дисплея и все записанные байты.
+static void on_twi_output(avr_irq_t *irq, uint32_t value, void *param)
+{
+    (void) irq;
+    (void) param;
+    avr_twi_msg_irq_t msg;
+    msg.u.v = value;
+
+    if (msg.u.twi.msg & TWI_COND_STOP)
+        lcd_selected = 0;
+
+    if (msg.u.twi.msg & TWI_COND_START) {
+        lcd_selected = 0;
+        if ((msg.u.twi.addr >> 1) == LCD_ADDRESS) {
+            lcd_selected = msg.u.twi.addr;
+            avr_raise_irq(lcd_irq + TWI_IRQ_INPUT, avr_twi_irq_msg(TWI_COND_ACK, lcd_selected, 1));
+        }
+    }
+
+    if (lcd_selected) {
+        if (msg.u.twi.msg & TWI_COND_WRITE)
+            avr_raise_irq(lcd_irq + TWI_IRQ_INPUT, avr_twi_irq_msg(TWI_COND_ACK, lcd_selected, 1));
+        if (msg.u.twi.msg & TWI_COND_READ)
+            avr_raise_irq(lcd_irq + TWI_IRQ_INPUT, avr_twi_irq_msg(TWI_COND_READ, lcd_selected, 0xFF));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s firmware.elf\n", argv[0]);
+        return 2;
+    }
+
+    elf_firmware_t firmware;
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(argv[1], &firmware) != 0) {
+        fprintf(stderr, "Cannot read %s\n", argv[1]);
+        return 1;
+    }
+
+    avr_t *const avr = avr_make_mcu_by_name(MCU_NAME);
+    if (avr == NULL) {
+        fprintf(stderr, "simavr does not support %s\n", MCU_NAME);
+        return 1;
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+    avr->frequency = MCU_FREQUENCY;
+
+    avr_register_io_write(avr, REG_GPIOR0, on_gpior0_write, NULL);
+
+    probe.temperature = 25.0;
+    sensor_irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), SENSOR_BIT);
+    avr_cycle_timer_register(avr, ONEWIRE_POLL_CYCLES, poll_onewire, NULL);
+
+    static const char *lcd_irq_names[2] = { "8>lcd.out", "32<lcd.in" };
+    lcd_irq = avr_alloc_irq(&avr->irq_pool, 0, 2, lcd_irq_names);
+    avr_irq_register_notify(lcd_irq + TWI_IRQ_OUTPUT, on_twi_output, NULL);
+    avr_connect_irq(lcd_irq + TWI_IRQ_INPUT, avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_INPUT));
+    avr_connect_irq(avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_OUTPUT), lcd_irq + TWI_IRQ_OUTPUT);
+
+    int state = cpu_Running;
+    while (state != cpu_Done && state != cpu_Crashed)
+        state = avr_run(avr);
+
+    if (state == cpu_Crashed) {
+        fprintf(stderr, "Firmware crashed at %llu cycles\n", (unsigned long long) avr->cycle);
+        return 1;
+    }
+
+    static const char *const names[] = BENCH_NAMES;
+    const avr_cycle_count_t overhead = stats[BENCH_EMPTY].count ? stats[BENCH_EMPTY].min : 0;
+
+    printf("%-28s %5s %12s %12s %12s %10s\n", "function", "runs", "min", "avg", "max", "avg, us");
+    for (int id = BENCH_EMPTY + 1; id < BENCH_COUNT; id++) {
+        const BenchStats &s = stats[id];
+        if (s.count == 0) {
+            printf("%-28s %5s\n", names[id], "-");
+            continue;
+        }
+        const double avg = (double) s.total / s.count - overhead;
+        printf("%-28s %5lu %12llu %12.0f %12llu %10.1f\n", names[id], s.count,
+            (unsigned long long) (s.min - overhead), avg, (unsigned long long) (s.max - overhead),
+            avg * 1e6 / MCU_FREQUENCY);
+    }
+    printf("(cycles at %d MHz, marker overhead of %llu cycles subtracted)\n", MCU_FREQUENCY / 1000000,
+        (unsigned long long) overhead);
+    return 0;
+}
@@ -0,0 +1,110 @@
+// Минимальная прослойка Arduino API для сборки прошивки на хосте (Linux).
+// Реализует ровно то, что используют src/main.cpp и библиотеки из lib/:
+// пины, АЦП, виртуальное время, регистры Timer1/PCINT, прерывания и Serial.
+// EEPROM - в EEPROM.h, как в ядре Arduino.
+// Управление моделью (время, внешние устройства) описано в ArduinoHost.h.
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "Print.h"
+#include "HardwareSerial.h"
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+// Частота ядра ATmega328 на плате Nano.
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+// Нумерация пинов как у Arduino Nano: D0..D13, затем A0..A7.
+#define NUM_DIGITAL_PINS 22
+#define A0 (14)
+#define A1 (15)
+#define A2 (16)
+#define A3 (17)
+#define A4 (18)
+#define A5 (19)
+#define A6 (20)
+#define A7 (21)
+
+// Двоичные константы из binary.h, которые используют библиотеки.
+#define B00000001 1
+#define B00000010 2
+#define B00000100 4
+#define B00001000 8
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *) (addr))
+#define pgm_read_word(addr) (*(const uint16_t *) (addr))
+#define pgm_read_ptr(addr) (*(const void *const *) (addr))
+#define PSTR(s) (s)
+#define F(s) ((const __FlashStringHelper *) (s))
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// Регистры таймера и прерываний, которые настраивает setup().
+// Модель читает их, чтобы решить, когда вызывать обработчики.
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint16_t OCR1A;
+extern volatile uint8_t TIMSK1;
+extern volatile uint8_t PCICR;
+extern volatile uint8_t PCMSK1;
+// Причина сброса. host_reset() выставляет PORF (подача питания); другую
+// причину можно записать в регистр после него.
+extern volatile uint8_t MCUSR;
+
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define OCIE1A 1
+#define PCIE1 1
+#define PC0 0
+#define PORF 0
+#define EXTRF 1
+#define BORF 2
+#define WDRF 3
+
+// Обработчики прерываний на хосте - обычные функции. Модель вызывает их
+// через слабые ссылки, поэтому прошивка может не определять часть из них.
+#define ISR(vector, ...) extern "C" void vector(void)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void TIMER1_COMPA_vect(void) __attribute__((weak));
+void PCINT1_vect(void) __attribute__((weak));
+#ifdef __cplusplus
+}
+#endif
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void);
+
+void noInterrupts(void);
+void interrupts(void);
+
+#endif
@@ -0,0 +1,71 @@
+// Управление моделью платы для сборки прошивки на хосте.
+// Время виртуальное: оно идёт только внутри delay(), delayMicroseconds(),
+// analogRead(), yield() и обменов по I2C, поэтому многочасовой цикл
+// сушки проигрывается за секунды.
+#ifndef ArduinoHost_h
+#define ArduinoHost_h
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Устройство, подключённое к цифровому пину с подтяжкой к питанию
+// (шина 1-wire и т.п.). Может притягивать линию к земле.
+class HostPinDevice
+{
+public:
+    virtual ~HostPinDevice() { }
+    // Прошивка начала (low == true) или закончила тянуть линию к земле.
+    virtual void master_changed(bool low, uint64_t now_us) = 0;
+    // Тянет ли устройство линию к земле в данный момент.
+    virtual bool pulls_low(uint64_t now_us) = 0;
+};
+
+// Ведомое устройство на шине I2C.
+class HostI2cDevice
+{
+public:
+    virtual ~HostI2cDevice() { }
+    // Начало транзакции. Возвращает false, если адрес не подтверждён (NAK).
+    virtual bool start(bool read) = 0;
+    // Запись байта. Возвращает false, если байт не подтверждён (NAK).
+    virtual bool write(uint8_t value) = 0;
+    // Чтение байта.
+    virtual uint8_t read(void) = 0;
+    // Конец транзакции (STOP).
+    virtual void stop(void) { }
+};
+
+// Обработчик, вызываемый на каждой виртуальной миллисекунде.
+// Может бросить исключение, чтобы прервать выполнение прошивки.
+typedef void (*HostTickHandler)(void);
+
+// Возвращает модель в состояние после подачи питания.
+void host_reset(void);
+// Текущее виртуальное время, мкс.
+uint64_t host_time_us(void);
+// Продвижение виртуального времени с вызовом прерываний и обработчика.
+void host_advance_us(uint32_t us);
+void host_set_tick_handler(HostTickHandler handler);
+
+// Напряжение на аналоговом пине в единицах АЦП (0..1023).
+// Изменение логического уровня вызывает PCINT, если он разрешён.
+void host_set_analog(uint8_t pin, int value);
+// Уровень, выставленный прошивкой на пине-выходе (HIGH/LOW).
+int host_pin_output(uint8_t pin);
+
+// Куда писать вывод Serial (NULL - отбрасывать) и что отдавать на чтение.
+void host_set_serial_output(FILE *stream);
+void host_set_serial_input(const char *data);
+
+// Содержимое EEPROM (E2END + 1 байт). Не сбрасывается host_reset().
+uint8_t *host_eeprom(void);
+// Стирание EEPROM (все байты 0xFF) и сброс счётчика записей.
+void host_erase_eeprom(void);
+// Сколько ячеек EEPROM записано с момента стирания.
+unsigned long host_eeprom_writes(void);
+
+void host_attach_pin_device(uint8_t pin, HostPinDevice *device);
+void host_attach_i2c_device(uint8_t address, HostI2cDevice *device);
+HostI2cDevice *host_i2c_device(uint8_t address);
+
+#endif
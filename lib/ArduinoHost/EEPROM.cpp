@@ -0,0 +1,52 @@
+#include <string.h>
+
+#include "ArduinoHost.h"
+#include "EEPROM.h"
+
+// Время стирания и записи ячейки EEPROM, мкс.
+#define EEPROM_WRITE_US (3400)
+
+EEPROMClass EEPROM;
+
+static uint8_t cells[E2END + 1];
+static bool cells_ready = false;
+static unsigned long cell_writes = 0;
+
+uint8_t *host_eeprom(void)
+{
+    // Чистая EEPROM заполнена единицами.
+    if (!cells_ready) {
+        memset(cells, 0xFF, sizeof(cells));
+        cells_ready = true;
+    }
+    return cells;
+}
+
+void host_erase_eeprom(void)
+{
+    cells_ready = false;
+    cell_writes = 0;
+}
+
+unsigned long host_eeprom_writes(void)
+{
+    return cell_writes;
+}
+
+uint8_t EEPROMClass::read(int address)
+{
+    return host_eeprom()[address & E2END];
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+    host_eeprom()[address & E2END] = value;
+    cell_writes++;
+    host_advance_us(EEPROM_WRITE_US);
+}
+
+void EEPROMClass::update(int address, uint8_t value)
+{
+    if (read(address) != value)
+        write(address, value);
+}
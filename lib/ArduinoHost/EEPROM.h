@@ -0,0 +1,42 @@
+// EEPROM для сборки на хосте: 1 КиБ, как у ATmega328P. Содержимое
+// переживает host_reset(), как настоящая EEPROM - выключение питания;
+// стирается host_erase_eeprom() (см. ArduinoHost.h).
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include <stdint.h>
+
+#define E2END 0x3FF
+
+class EEPROMClass
+{
+public:
+    uint8_t read(int address);
+    // Запись ячейки занимает 3.4 мс виртуального времени.
+    void write(int address, uint8_t value);
+    // Запись только изменившейся ячейки.
+    void update(int address, uint8_t value);
+    uint16_t length(void) { return E2END + 1; }
+
+    template <typename T>
+    T &get(int address, T &value)
+    {
+        uint8_t *const bytes = (uint8_t *) &value;
+        for (unsigned i = 0; i < sizeof(T); i++)
+            bytes[i] = read(address + i);
+        return value;
+    }
+
+    template <typename T>
+    const T &put(int address, const T &value)
+    {
+        const uint8_t *const bytes = (const uint8_t *) &value;
+        for (unsigned i = 0; i < sizeof(T); i++)
+            update(address + i, bytes[i]);
+        return value;
+    }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
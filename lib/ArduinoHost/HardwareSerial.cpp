@@ -0,0 +1,44 @@
+#include <stdio.h>
+
+#include "ArduinoHost.h"
+#include "HardwareSerial.h"
+
+HardwareSerial Serial;
+
+static FILE *serial_output = NULL;
+static const char *serial_input = NULL;
+
+void host_set_serial_output(FILE *stream)
+{
+    serial_output = stream;
+}
+
+void host_set_serial_input(const char *data)
+{
+    serial_input = data;
+}
+
+int HardwareSerial::available(void)
+{
+    return serial_input != NULL && *serial_input ? 1 : 0;
+}
+
+int HardwareSerial::read(void)
+{
+    if (!available())
+        return -1;
+    return (uint8_t) *serial_input++;
+}
+
+void HardwareSerial::flush(void)
+{
+    if (serial_output != NULL)
+        fflush(serial_output);
+}
+
+size_t HardwareSerial::write(uint8_t value)
+{
+    if (serial_output != NULL)
+        fputc(value, serial_output);
+    return 1;
+}
@@ -0,0 +1,25 @@
+// Последовательный порт для сборки на хосте. Вывод уходит в поток,
+// заданный host_set_serial_output() (по умолчанию отбрасывается).
+#ifndef HardwareSerial_h
+#define HardwareSerial_h
+
+#include <stdint.h>
+
+#include "Print.h"
+
+class HardwareSerial : public Print
+{
+public:
+    void begin(unsigned long baud) { (void) baud; }
+    void end(void) { }
+    int available(void);
+    int read(void);
+    void flush(void);
+    size_t write(uint8_t value);
+    using Print::write;
+    operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
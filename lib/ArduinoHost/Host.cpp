@@ -0,0 +1,255 @@
+#include <Arduino.h>
+
+#include "ArduinoHost.h"
+
+// Длительность одного преобразования АЦП: 13 тактов АЦП на 125 кГц.
+#define ADC_CONVERSION_US (104)
+// Порог переключения логического уровня входа, ед. АЦП.
+#define LOGIC_THRESHOLD (512)
+// Сколько виртуального времени отдаёт yield().
+#define YIELD_US (1000)
+
+volatile uint8_t TCCR1A = 0;
+volatile uint8_t TCCR1B = 0;
+volatile uint16_t OCR1A = 0;
+volatile uint8_t TIMSK1 = 0;
+volatile uint8_t PCICR = 0;
+volatile uint8_t PCMSK1 = 0;
+volatile uint8_t MCUSR = 0;
+
+static uint64_t now_us = 0;
+static HostTickHandler tick_handler = NULL;
+
+static bool interrupts_enabled = true;
+static bool in_isr = false;
+static bool timer1_pending = false;
+static bool pcint1_pending = false;
+static uint64_t timer1_deadline = 0;
+
+static uint8_t pin_mode[NUM_DIGITAL_PINS];
+static uint8_t pin_out[NUM_DIGITAL_PINS];
+static int pin_analog[NUM_DIGITAL_PINS];
+static HostPinDevice *pin_device[NUM_DIGITAL_PINS];
+static bool pin_driven_low[NUM_DIGITAL_PINS];
+
+static HostI2cDevice *i2c_devices[128];
+
+void host_reset(void)
+{
+    TCCR1A = TCCR1B = TIMSK1 = PCICR = PCMSK1 = 0;
+    OCR1A = 0;
+    MCUSR = 1 << PORF;
+    now_us = 0;
+    interrupts_enabled = true;
+    in_isr = false;
+    timer1_pending = pcint1_pending = false;
+    timer1_deadline = 0;
+    for (uint8_t pin = 0; pin < NUM_DIGITAL_PINS; pin++) {
+        pin_mode[pin] = INPUT;
+        pin_out[pin] = LOW;
+        pin_analog[pin] = 0;
+        pin_device[pin] = NULL;
+        pin_driven_low[pin] = false;
+    }
+    for (uint8_t addr = 0; addr < 128; addr++)
+        i2c_devices[addr] = NULL;
+}
+
+uint64_t host_time_us(void)
+{
+    return now_us;
+}
+
+void host_set_tick_handler(HostTickHandler handler)
+{
+    tick_handler = handler;
+}
+
+// Вызов отложенных обработчиков прерываний, если они разрешены.
+static void dispatch_interrupts(void)
+{
+    if (!interrupts_enabled || in_isr)
+        return;
+    in_isr = true;
+    if (timer1_pending) {
+        timer1_pending = false;
+        if (TIMER1_COMPA_vect)
+            TIMER1_COMPA_vect();
+    }
+    if (pcint1_pending) {
+        pcint1_pending = false;
+        if (PCINT1_vect)
+            PCINT1_vect();
+    }
+    in_isr = false;
+}
+
+// Период прерывания Timer1 в режиме CTC, мкс. 0 - таймер остановлен.
+static uint64_t timer1_period_us(void)
+{
+    static const uint16_t prescalers[] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+    const uint16_t prescaler = prescalers[TCCR1B & 0x07];
+
+    if (prescaler == 0 || !(TIMSK1 & (1 << OCIE1A)))
+        return 0;
+    return ((uint64_t) OCR1A + 1) * prescaler * 1000000ULL / F_CPU;
+}
+
+void host_advance_us(uint32_t us)
+{
+    const uint64_t target = now_us + us;
+
+    while (now_us < target) {
+        const uint64_t period = timer1_period_us();
+        if (period == 0)
+            timer1_deadline = 0;
+        else if (timer1_deadline == 0)
+            timer1_deadline = now_us + period;
+
+        uint64_t next = (now_us / 1000 + 1) * 1000;
+        if (next > target)
+            next = target;
+        if (timer1_deadline != 0 && timer1_deadline < next)
+            next = timer1_deadline;
+        now_us = next;
+
+        if (now_us == timer1_deadline) {
+            timer1_deadline += period;
+            timer1_pending = true;
+        }
+        dispatch_interrupts();
+
+        if (now_us % 1000 == 0 && tick_handler != NULL)
+            tick_handler();
+    }
+}
+
+// Уведомляет устройство на пине, если прошивка изменила своё
+// воздействие на линию.
+static void update_pin_drive(uint8_t pin)
+{
+    const bool low = pin_mode[pin] == OUTPUT && pin_out[pin] == LOW;
+    if (low == pin_driven_low[pin])
+        return;
+    pin_driven_low[pin] = low;
+    if (pin_device[pin] != NULL)
+        pin_device[pin]->master_changed(low, now_us);
+}
+
+void host_set_analog(uint8_t pin, int value)
+{
+    if (pin >= NUM_DIGITAL_PINS)
+        return;
+    const bool was_high = pin_analog[pin] >= LOGIC_THRESHOLD;
+    pin_analog[pin] = value;
+    const bool is_high = value >= LOGIC_THRESHOLD;
+
+    if (was_high != is_high && pin >= A0 && pin <= A5
+        && (PCICR & (1 << PCIE1)) && (PCMSK1 & (1 << (pin - A0)))) {
+        pcint1_pending = true;
+        dispatch_interrupts();
+    }
+}
+
+int host_pin_output(uint8_t pin)
+{
+    if (pin >= NUM_DIGITAL_PINS || pin_mode[pin] != OUTPUT)
+        return LOW;
+    return pin_out[pin];
+}
+
+void host_attach_pin_device(uint8_t pin, HostPinDevice *device)
+{
+    if (pin < NUM_DIGITAL_PINS)
+        pin_device[pin] = device;
+}
+
+void host_attach_i2c_device(uint8_t address, HostI2cDevice *device)
+{
+    i2c_devices[address & 0x7F] = device;
+}
+
+HostI2cDevice *host_i2c_device(uint8_t address)
+{
+    return i2c_devices[address & 0x7F];
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if (pin >= NUM_DIGITAL_PINS)
+        return;
+    pin_mode[pin] = mode;
+    update_pin_drive(pin);
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    if (pin >= NUM_DIGITAL_PINS)
+        return;
+    pin_out[pin] = val ? HIGH : LOW;
+    update_pin_drive(pin);
+}
+
+int digitalRead(uint8_t pin)
+{
+    if (pin >= NUM_DIGITAL_PINS)
+        return LOW;
+    if (pin_device[pin] != NULL) {
+        if (pin_driven_low[pin] || pin_device[pin]->pulls_low(now_us))
+            return LOW;
+        return HIGH;
+    }
+    if (pin_mode[pin] == OUTPUT)
+        return pin_out[pin];
+    if (pin_mode[pin] == INPUT_PULLUP)
+        return HIGH;
+    return pin_analog[pin] >= LOGIC_THRESHOLD ? HIGH : LOW;
+}
+
+int analogRead(uint8_t pin)
+{
+    // На AVR допустимы и номера каналов (0..7), и номера пинов (A0..A7).
+    if (pin < A0)
+        pin += A0;
+    host_advance_us(ADC_CONVERSION_US);
+    if (pin >= NUM_DIGITAL_PINS)
+        return 0;
+    return pin_analog[pin];
+}
+
+unsigned long millis(void)
+{
+    return (unsigned long) (now_us / 1000);
+}
+
+unsigned long micros(void)
+{
+    return (unsigned long) now_us;
+}
+
+void delay(unsigned long ms)
+{
+    while (ms--)
+        host_advance_us(1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    host_advance_us(us);
+}
+
+void yield(void)
+{
+    host_advance_us(YIELD_US);
+}
+
+void noInterrupts(void)
+{
+    interrupts_enabled = false;
+}
+
+void interrupts(void)
+{
+    interrupts_enabled = true;
+    dispatch_interrupts();
+}
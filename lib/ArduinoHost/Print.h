@@ -0,0 +1,52 @@
+// Упрощённый класс Print из ядра Arduino: форматированный вывод
+// поверх единственного виртуального метода write(uint8_t).
+#ifndef Print_h
+#define Print_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// Строка во флеш-памяти (F(), PROGMEM). На хосте флеш и ОЗУ общие, тип
+// нужен только для выбора перегрузки print(), как в ядре Arduino.
+class __FlashStringHelper;
+
+class Print
+{
+public:
+    virtual ~Print() { }
+
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *str);
+
+    size_t print(const __FlashStringHelper *);
+    size_t print(const char[]);
+    size_t print(char);
+    size_t print(unsigned char, int = DEC);
+    size_t print(int, int = DEC);
+    size_t print(unsigned int, int = DEC);
+    size_t print(long, int = DEC);
+    size_t print(unsigned long, int = DEC);
+    size_t print(double, int = 2);
+
+    size_t println(void);
+    size_t println(const __FlashStringHelper *);
+    size_t println(const char[]);
+    size_t println(char);
+    size_t println(unsigned char, int = DEC);
+    size_t println(int, int = DEC);
+    size_t println(unsigned int, int = DEC);
+    size_t println(long, int = DEC);
+    size_t println(unsigned long, int = DEC);
+    size_t println(double, int = 2);
+
+private:
+    size_t print_number(unsigned long, uint8_t);
+};
+
+#endif
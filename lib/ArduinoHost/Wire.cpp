@@ -0,0 +1,93 @@
+#include "ArduinoHost.h"
+#include "Wire.h"
+
+TwoWire Wire;
+
+void TwoWire::begin(void)
+{
+    tx_length = 0;
+    rx_length = rx_index = 0;
+}
+
+void TwoWire::setClock(uint32_t clock)
+{
+    this->clock = clock;
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+    tx_address = address;
+    tx_length = 0;
+}
+
+size_t TwoWire::write(uint8_t value)
+{
+    if (tx_length >= BUFFER_LENGTH)
+        return 0;
+    tx_buffer[tx_length++] = value;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t quantity)
+{
+    size_t n = 0;
+    while (quantity--)
+        n += write(*data++);
+    return n;
+}
+
+uint8_t TwoWire::endTransmission(bool stop)
+{
+    HostI2cDevice *const device = host_i2c_device(tx_address);
+    uint8_t result = 0;
+    uint8_t sent = 0;
+
+    if (device == NULL || !device->start(false)) {
+        result = 2;
+    } else {
+        for (; sent < tx_length; sent++) {
+            if (!device->write(tx_buffer[sent])) {
+                result = 3;
+                sent++;
+                break;
+            }
+        }
+        if (stop)
+            device->stop();
+    }
+
+    host_advance_us(byte_time_us() * (1 + sent));
+    tx_length = 0;
+    return result;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, bool stop)
+{
+    HostI2cDevice *const device = host_i2c_device(address);
+
+    if (quantity > BUFFER_LENGTH)
+        quantity = BUFFER_LENGTH;
+    rx_index = rx_length = 0;
+
+    if (device != NULL && device->start(true)) {
+        while (rx_length < quantity)
+            rx_buffer[rx_length++] = device->read();
+        if (stop)
+            device->stop();
+    }
+
+    host_advance_us(byte_time_us() * (1 + rx_length));
+    return rx_length;
+}
+
+int TwoWire::available(void)
+{
+    return rx_length - rx_index;
+}
+
+int TwoWire::read(void)
+{
+    if (rx_index >= rx_length)
+        return -1;
+    return rx_buffer[rx_index++];
+}
@@ -0,0 +1,50 @@
+// Шина I2C (TWI) для сборки на хосте. Транзакции передаются моделям
+// ведомых устройств (см. host_attach_i2c_device() в ArduinoHost.h).
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BUFFER_LENGTH 32
+
+class TwoWire
+{
+public:
+    void begin(void);
+    void setClock(uint32_t clock);
+
+    void beginTransmission(uint8_t address);
+    void beginTransmission(int address) { beginTransmission((uint8_t) address); }
+    // Возвращает 0 при успехе, 2 - NAK на адрес, 3 - NAK на данные.
+    uint8_t endTransmission(bool stop = true);
+
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, bool stop = true);
+    uint8_t requestFrom(int address, int quantity) { return requestFrom((uint8_t) address, (uint8_t) quantity); }
+
+    size_t write(uint8_t value);
+    size_t write(const uint8_t *data, size_t quantity);
+    size_t write(int value) { return write((uint8_t) value); }
+    size_t write(unsigned int value) { return write((uint8_t) value); }
+    size_t write(long value) { return write((uint8_t) value); }
+    size_t write(unsigned long value) { return write((uint8_t) value); }
+
+    int available(void);
+    int read(void);
+
+private:
+    // Время передачи одного байта с битом подтверждения, мкс.
+    uint32_t byte_time_us(void) const { return 9 * 1000000UL / clock; }
+
+    uint32_t clock = 100000;
+    uint8_t tx_address = 0;
+    uint8_t tx_buffer[BUFFER_LENGTH];
+    uint8_t tx_length = 0;
+    uint8_t rx_buffer[BUFFER_LENGTH];
+    uint8_t rx_length = 0;
+    uint8_t rx_index = 0;
+};
+
+extern TwoWire Wire;
+
+#endif
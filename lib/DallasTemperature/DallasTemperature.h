@@ -247,6 +247,10 @@ public:
 	// convert from raw to Fahrenheit
 	static float rawToFahrenheit(int16_t);
 
+	// reads scratchpad and returns the raw temperature
+	// (public so that benchmarks can time the decoding alone)
+	int16_t calculateTemperature(const uint8_t*, uint8_t*);
+
 #if REQUIRESNEW
 
 	// initialize memory area
@@ -289,9 +293,6 @@ private:
 	// Take a pointer to one wire instance
 	OneWire* _wire;
 
-	// reads scratchpad and returns the raw temperature
-	int16_t calculateTemperature(const uint8_t*, uint8_t*);
-
 	void blockTillConversionComplete(uint8_t);
 
 	// Returns true if all bytes of scratchPad are '\0'
@@ -142,6 +142,7 @@ sample code bearing this copyright.
 #include <Arduino.h>
 #include "OneWire.h"
 #include "util/OneWire_direct_gpio.h"
+#include "util/OneWire_crc8_table.h"
 
 
 void OneWire::begin(uint8_t pin)
@@ -489,16 +490,11 @@ bool OneWire::search(uint8_t *newAddr, bool search_mode /* = true */)
 // "Understanding and Using Cyclic Redundancy Checks with Maxim iButton Products"
 //
 
-#if ONEWIRE_CRC8_TABLE
+#if ONEWIRE_CRC8_TABLE == 1
 // Dow-CRC using polynomial X^8 + X^5 + X^4 + X^0
 // Tiny 2x16 entry CRC table created by Arjen Lentz
 // See http://lentz.com.au/blog/calculating-crc-with-a-tiny-32-entry-lookup-table
-static const uint8_t PROGMEM dscrc2x16_table[] = {
-	0x00, 0x5E, 0xBC, 0xE2, 0x61, 0x3F, 0xDD, 0x83,
-	0xC2, 0x9C, 0x7E, 0x20, 0xA3, 0xFD, 0x1F, 0x41,
-	0x00, 0x9D, 0x23, 0xBE, 0x46, 0xDB, 0x65, 0xF8,
-	0x8C, 0x11, 0xAF, 0x32, 0xCA, 0x57, 0xE9, 0x74
-};
+static const uint8_t PROGMEM dscrc2x16_table[] = ONEWIRE_DSCRC2X16_TABLE;
 
 // Compute a Dallas Semiconductor 8 bit CRC. These show up in the ROM
 // and the registers.  (Use tiny 2x16 entry CRC table)
@@ -514,6 +510,30 @@ uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len)
 
 	return crc;
 }
+#elif ONEWIRE_CRC8_TABLE == 2
+// Full 256 entry table in flash: one lookup per byte.
+static const uint8_t PROGMEM dscrc_table[] = ONEWIRE_DSCRC_TABLE;
+
+uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len)
+{
+	uint8_t crc = 0;
+
+	while (len--)
+		crc = pgm_read_byte(dscrc_table + (crc ^ *addr++));
+	return crc;
+}
+#elif ONEWIRE_CRC8_TABLE == 3
+// Full 256 entry table in RAM: plain loads instead of LPM on AVR.
+static const uint8_t dscrc_table[] = ONEWIRE_DSCRC_TABLE;
+
+uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len)
+{
+	uint8_t crc = 0;
+
+	while (len--)
+		crc = dscrc_table[crc ^ *addr++];
+	return crc;
+}
 #else
 //
 // Compute a Dallas Semiconductor 8 bit CRC directly.
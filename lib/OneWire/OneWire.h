@@ -36,11 +36,14 @@
 #define ONEWIRE_CRC 1
 #endif
 
-// Select the table-lookup method of computing the 8-bit CRC
-// by setting this to 1.  The lookup table enlarges code size by
-// about 250 bytes.  It does NOT consume RAM (but did in very
-// old versions of OneWire).  If you disable this, a slower
-// but very compact algorithm is used.
+// Select the method of computing the 8-bit CRC:
+//   0 - bitwise (_crc_ibutton_update on AVR): smallest, slowest;
+//   1 - 2x16 entry nibble table in flash: a few dozen bytes more;
+//   2 - 256 entry table in flash: about 250 bytes more, one lookup
+//       per byte;
+//   3 - 256 entry table in RAM: like 2, but costs 256 bytes of RAM
+//       and avoids LPM on AVR.
+// bench/run.sh prints cycles and flash cost of each variant.
 #ifndef ONEWIRE_CRC8_TABLE
 #define ONEWIRE_CRC8_TABLE 1
 #endif
@@ -402,6 +402,22 @@ void directWriteHigh(IO_REG_TYPE mask)
 #define DIRECT_MODE_INPUT(base, mask)    directModeInput(mask)
 #define DIRECT_MODE_OUTPUT(base, mask)   directModeOutput(mask)
 
+#elif defined(ARDUINO_HOST)
+// Host build (PlatformIO "native" env): the bus is modelled by the
+// ArduinoHost shim on top of the regular pin API, with a virtual clock.
+#define PIN_TO_BASEREG(pin)             (0)
+#define PIN_TO_BITMASK(pin)             (pin)
+#define IO_REG_TYPE unsigned int
+#define IO_REG_BASE_ATTR
+#define IO_REG_MASK_ATTR
+// The register base is unused here; referencing it keeps -Wall quiet
+// about the "reg" locals in OneWire.cpp.
+#define DIRECT_READ(base, pin)          ((void)(base), digitalRead(pin))
+#define DIRECT_WRITE_LOW(base, pin)     ((void)(base), digitalWrite(pin, LOW))
+#define DIRECT_WRITE_HIGH(base, pin)    ((void)(base), digitalWrite(pin, HIGH))
+#define DIRECT_MODE_INPUT(base, pin)    ((void)(base), pinMode(pin,INPUT))
+#define DIRECT_MODE_OUTPUT(base, pin)   ((void)(base), pinMode(pin,OUTPUT))
+
 #else
 #define PIN_TO_BASEREG(pin)             (0)
 #define PIN_TO_BITMASK(pin)             (pin)
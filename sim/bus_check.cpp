@@ -0,0 +1,151 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <ArduinoHost.h>
+#include <OneWire.h>
+#include <DallasTemperature.h>
+
+#include "thermostat.h"
+#include "ds18b20.h"
+#include "onewire_bus.h"
+#include "scenarios.h"
+
+static int failures = 0;
+
+static void check(bool condition, const char *what)
+{
+    printf("%s %s\n", condition ? "  ok  " : "  FAIL", what);
+    if (!condition)
+        failures++;
+}
+
+static void print_stats(const char *what, const OneWireBus &bus, uint64_t elapsed_us)
+{
+    const OneWireStats &stats = bus.stats();
+    printf("        %-24s %3lu resets %5lu read %5lu write slots, %7.2f ms\n", what, stats.resets,
+        stats.read_slots, stats.write_slots, elapsed_us / 1000.0);
+}
+
+static Ds18b20 *find_device(Ds18b20 *const *devices, uint8_t count, const uint8_t *address)
+{
+    for (uint8_t i = 0; i < count; i++)
+        if (!memcmp(devices[i]->rom(), address, 8))
+            return devices[i];
+    return NULL;
+}
+
+int run_bus_check(void)
+{
+    Ds18b20 first(0x000000000001ULL);
+    Ds18b20 second(0x0000000000F2ULL);
+    Ds18b20 third(0x800000000013ULL);
+    Ds18b20 *const devices[] = { &first, &second, &third };
+    const uint8_t count = sizeof(devices) / sizeof(devices[0]);
+
+    first.temperature = 21.3;
+    second.temperature = 48.77;
+    third.temperature = -5.5;
+    third.parasite = true;
+
+    OneWireBus bus;
+    for (uint8_t i = 0; i < count; i++)
+        bus.attach(devices[i]);
+
+    host_reset();
+    host_attach_pin_device(SENSOR_PIN, &bus);
+
+    OneWire wire(SENSOR_PIN);
+    DallasTemperature sensors(&wire);
+    DeviceAddress address;
+    uint64_t started = host_time_us();
+
+    printf("enumeration\n");
+    bus.reset_stats();
+    sensors.begin();
+    print_stats("begin()", bus, host_time_us() - started);
+    check(sensors.getDeviceCount() == count, "all devices found by ROM search");
+    check(sensors.isParasitePowerMode(), "parasite device detected");
+
+    bool all_known = true;
+    for (uint8_t i = 0; i < count; i++)
+        all_known &= sensors.getAddress(address, i) && find_device(devices, count, address) != NULL;
+    check(all_known, "getAddress() returns valid ROM codes");
+    check(!sensors.getAddress(address, count), "no phantom device past the end");
+
+    printf("resolution and conversion timing\n");
+    for (uint8_t resolution = 9; resolution <= 12; resolution++) {
+        sensors.setResolution(resolution);
+
+        bool resolution_ok = true;
+        for (uint8_t i = 0; i < count; i++) {
+            sensors.getAddress(address, i);
+            resolution_ok &= sensors.getResolution(address) == resolution;
+        }
+
+        bus.reset_stats();
+        started = host_time_us();
+        sensors.requestTemperatures();
+        const uint64_t elapsed = host_time_us() - started;
+
+        char what[64];
+        snprintf(what, sizeof(what), "requestTemperatures() %u bit", resolution);
+        print_stats(what, bus, elapsed);
+
+        snprintf(what, sizeof(what), "%u bit resolution set on every device", resolution);
+        check(resolution_ok, what);
+        snprintf(what, sizeof(what), "%u bit conversion waits at least datasheet time",
+            resolution);
+        check(elapsed >= (93750ULL << (resolution - 9)), what);
+
+        // Шаг квантования при данном разрешении.
+        const double step = 0.0625 * (1 << (12 - resolution));
+        bool values_ok = true;
+        for (uint8_t i = 0; i < count; i++) {
+            sensors.getAddress(address, i);
+            const Ds18b20 *const device = find_device(devices, count, address);
+            const float value = sensors.getTempC(address);
+            values_ok &= fabs(value - device->temperature) <= step;
+        }
+        snprintf(what, sizeof(what), "%u bit readings match within %.4f *C", resolution, step);
+        check(values_ok, what);
+    }
+    check(third.failed_conversions == 0, "parasite device kept powered during conversions");
+
+    printf("single device access\n");
+    sensors.getAddress(address, 0);
+    bus.reset_stats();
+    started = host_time_us();
+    sensors.getTempC(address);
+    print_stats("getTempC(address)", bus, host_time_us() - started);
+    bus.reset_stats();
+    started = host_time_us();
+    sensors.getTempCByIndex(0);
+    print_stats("getTempCByIndex(0)", bus, host_time_us() - started);
+
+    printf("alarm search\n");
+    for (uint8_t i = 0; i < count; i++) {
+        sensors.getAddress(address, i);
+        const Ds18b20 *const device = find_device(devices, count, address);
+        // Тревога только у второго датчика (48.77 > 40).
+        sensors.setHighAlarmTemp(address, device == &second ? 40 : 100);
+        sensors.setLowAlarmTemp(address, -20);
+    }
+    sensors.requestTemperatures();
+
+    uint8_t alarms = 0;
+    bool alarm_ok = true;
+    bus.reset_stats();
+    started = host_time_us();
+    sensors.resetAlarmSearch();
+    while (sensors.alarmSearch(address)) {
+        alarms++;
+        alarm_ok &= find_device(devices, count, address) == &second;
+    }
+    print_stats("alarmSearch() loop", bus, host_time_us() - started);
+    check(alarms == 1 && alarm_ok, "only the device above TH answers the alarm search");
+
+    printf("\n%s: %d failure(s)\n", failures ? "FAILED" : "PASSED", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <Arduino.h>
+#include <OneWire.h>
+
+#include "../bench/crc_variants.h"
+#include "scenarios.h"
+
+// Размер буфера и сколько данных прогонять через каждый вариант.
+#define BENCH_BUFFER (240)
+#define BENCH_BYTES (64UL << 20)
+
+typedef uint8_t (*Crc8Fn)(const uint8_t *data, uint8_t len);
+
+struct Crc8Variant
+{
+    const char *name;
+    Crc8Fn fn;
+};
+
+static const Crc8Variant variants[] = {
+    { "crc8 bitwise (table=0)", crc8_bitwise },
+    { "crc8 nibble (table=1)", crc8_nibble },
+    { "crc8 flash 256 (table=2)", crc8_table_flash },
+    { "crc8 RAM 256 (table=3)", crc8_table_ram },
+    { "OneWire::crc8 (as built)", OneWire::crc8 },
+};
+
+static int failures = 0;
+
+static void check(bool condition, const char *what)
+{
+    printf("%s %s\n", condition ? "  ok  " : "  FAIL", what);
+    if (!condition)
+        failures++;
+}
+
+static double seconds_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Побитовый вариант на хосте - эталон. Первый байт пары переводит CRC
+// из нуля в любое из 256 состояний (таблица - перестановка), второй
+// проверяет переход из этого состояния по любому байту: 65536 пар
+// покрывают функцию обновления CRC целиком.
+static bool crc8_matches_everywhere(Crc8Fn fn)
+{
+    uint8_t pair[2];
+    for (unsigned first = 0; first < 256; first++) {
+        pair[0] = first;
+        for (unsigned second = 0; second < 256; second++) {
+            pair[1] = second;
+            if (fn(pair, 2) != crc8_bitwise(pair, 2))
+                return false;
+        }
+    }
+    // Вырожденный случай: пустой буфер.
+    return fn(pair, 0) == 0;
+}
+
+// То же для CRC-16: начальное значение перебирает все 65536 состояний.
+static bool crc16_matches_everywhere(void)
+{
+    for (uint32_t crc = 0; crc < 0x10000; crc++) {
+        for (unsigned value = 0; value < 256; value++) {
+            const uint8_t byte = value;
+            if (OneWire::crc16(&byte, 1, crc) != crc16_reference(&byte, 1, crc))
+                return false;
+        }
+    }
+    return true;
+}
+
+int run_crc_bench(void)
+{
+    printf("equivalence:\n");
+    for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); i++) {
+        char what[80];
+        snprintf(what, sizeof(what), "%s matches bitwise CRC-8 for every state and byte", variants[i].name);
+        check(crc8_matches_everywhere(variants[i].fn), what);
+    }
+    check(crc16_matches_everywhere(), "OneWire::crc16 matches bitwise CRC-16 for every state and byte");
+
+    // Контрольные значения из примеров Maxim AN27 и блокнота DS18B20.
+    const uint8_t rom[8] = { 0x02, 0x1C, 0xB8, 0x01, 0x00, 0x00, 0x00, 0xA2 };
+    check(OneWire::crc8(rom, 7) == rom[7] && OneWire::crc8(rom, 8) == 0, "ROM from AN27 has a valid CRC");
+    const uint8_t scratchpad[9] = { 0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10, 0x1C };
+    check(OneWire::crc8(scratchpad, 8) == scratchpad[8], "power-on scratchpad has a valid CRC");
+    uint8_t with_crc[11] = { 0x0F, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    const uint16_t inverted = ~OneWire::crc16(with_crc, 9);
+    with_crc[9] = inverted & 0xFF;
+    with_crc[10] = inverted >> 8;
+    check(OneWire::check_crc16(with_crc, 9, with_crc + 9), "check_crc16 accepts its own inverted CRC");
+
+    printf("\nhost throughput (%u byte buffers, %lu MiB each):\n", BENCH_BUFFER, BENCH_BYTES >> 20);
+    uint8_t buffer[BENCH_BUFFER];
+    for (unsigned i = 0; i < sizeof(buffer); i++)
+        buffer[i] = (uint8_t) (i * 167 + 13);
+
+    volatile uint16_t sink = 0;
+    for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); i++) {
+        const double start = seconds_now();
+        for (unsigned long done = 0; done < BENCH_BYTES; done += sizeof(buffer)) {
+            buffer[0] = (uint8_t) done;
+            sink = sink + variants[i].fn(buffer, sizeof(buffer));
+        }
+        const double elapsed = seconds_now() - start;
+        printf("        %-28s %8.1f MB/s\n", variants[i].name, BENCH_BYTES / elapsed / 1e6);
+    }
+    const double start = seconds_now();
+    for (unsigned long done = 0; done < BENCH_BYTES; done += sizeof(buffer)) {
+        buffer[0] = (uint8_t) done;
+        sink = sink + OneWire::crc16(buffer, sizeof(buffer));
+    }
+    printf("        %-28s %8.1f MB/s\n", "OneWire::crc16", BENCH_BYTES / (seconds_now() - start) / 1e6);
+
+    printf("\nAVR cycles and flash cost: bench/run.sh\n");
+    printf("%s: %d failure(s)\n", failures ? "FAILED" : "PASSED", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,335 @@
+#include <math.h>
+#include <string.h>
+
+#include "ds18b20.h"
+
+// Минимальная длительность импульса сброса, мкс.
+#define RESET_MIN_US (480)
+// Граница между записью единицы и нуля: датчик опрашивает линию
+// через 15-60 мкс после спада, здесь берём нижнюю границу.
+#define WRITE_SAMPLE_US (15)
+// Сколько датчик удерживает линию при передаче нуля, мкс.
+#define READ_ZERO_US (30)
+// Задержка и длительность импульса присутствия, мкс.
+#define PRESENCE_DELAY_US (30)
+#define PRESENCE_US (120)
+// Время измерения при разрешении 9 бит, мкс. Каждый следующий бит
+// разрешения удваивает его (до 750 мс при 12 битах).
+#define CONVERSION_9BIT_US (93750)
+
+// ROM-команды.
+#define CMD_SEARCH_ROM (0xF0)
+#define CMD_READ_ROM (0x33)
+#define CMD_MATCH_ROM (0x55)
+#define CMD_SKIP_ROM (0xCC)
+#define CMD_ALARM_SEARCH (0xEC)
+// Функциональные команды.
+#define CMD_CONVERT_T (0x44)
+#define CMD_READ_SCRATCHPAD (0xBE)
+#define CMD_WRITE_SCRATCHPAD (0x4E)
+#define CMD_COPY_SCRATCHPAD (0x48)
+#define CMD_RECALL_EEPROM (0xB8)
+#define CMD_READ_POWER_SUPPLY (0xB4)
+
+// Положение регистров в блокноте.
+#define SP_TH (2)
+#define SP_TL (3)
+#define SP_CONFIG (4)
+#define SP_CRC (8)
+
+uint8_t dallas_crc8(const uint8_t *data, uint8_t len)
+{
+    uint8_t crc = 0;
+
+    while (len--) {
+        uint8_t byte = *data++;
+        for (uint8_t i = 0; i < 8; i++) {
+            const uint8_t mix = (crc ^ byte) & 0x01;
+            crc >>= 1;
+            if (mix)
+                crc ^= 0x8C;
+            byte >>= 1;
+        }
+    }
+    return crc;
+}
+
+Ds18b20::Ds18b20(uint64_t serial)
+    : temperature(25.0)
+    , parasite(false)
+    , failed_conversions(0)
+    , scratchpad_hook(NULL)
+    , scratchpad_context(NULL)
+    , alarm(false)
+    , state(Inactive)
+    , fall_us(0)
+    , slot_is_read(false)
+    , pull_from_us(0)
+    , pull_until_us(0)
+    , rx_byte(0)
+    , rx_bits(0)
+    , rx_count(0)
+    , tx_len(0)
+    , tx_pos(0)
+    , search_bit(0)
+    , search_phase(0)
+    , converting(false)
+    , conversion_end_us(0)
+{
+    rom_code[0] = DS18B20_FAMILY;
+    for (uint8_t i = 1; i < 7; i++) {
+        rom_code[i] = serial & 0xFF;
+        serial >>= 8;
+    }
+    rom_code[7] = dallas_crc8(rom_code, 7);
+
+    // Состояние после подачи питания: 85 °C, пороги и конфигурация
+    // (12 бит) загружены из EEPROM.
+    const uint8_t power_on[8] = { 0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10 };
+    memcpy(scratchpad, power_on, sizeof(power_on));
+    scratchpad[SP_CRC] = dallas_crc8(scratchpad, 8);
+    memcpy(eeprom, scratchpad + SP_TH, sizeof(eeprom));
+}
+
+void Ds18b20::set_user_data(int16_t data)
+{
+    scratchpad[SP_TH] = (uint16_t) data >> 8;
+    scratchpad[SP_TL] = data & 0xFF;
+    scratchpad[SP_CRC] = dallas_crc8(scratchpad, 8);
+    memcpy(eeprom, scratchpad + SP_TH, sizeof(eeprom));
+}
+
+bool Ds18b20::pulls_low(uint64_t now_us)
+{
+    return now_us >= pull_from_us && now_us < pull_until_us;
+}
+
+void Ds18b20::master_changed(bool low, uint64_t now_us)
+{
+    if (low) {
+        fall_us = now_us;
+        // Без сильной подтяжки датчику на паразитном питании не хватает
+        // энергии, и начатое измерение теряется.
+        if (parasite && converting && now_us < conversion_end_us) {
+            converting = false;
+            failed_conversions++;
+        }
+        slot_is_read = state == SearchRom ? search_phase < 2
+                                          : state == TransmitData || state == ConversionStatus;
+        // При передаче нуля датчик подхватывает линию сразу после спада.
+        if (slot_is_read && next_tx_bit(now_us) == 0) {
+            pull_from_us = now_us;
+            pull_until_us = now_us + READ_ZERO_US;
+        }
+        return;
+    }
+
+    const uint64_t duration = now_us - fall_us;
+    if (duration >= RESET_MIN_US) {
+        on_reset(now_us);
+        return;
+    }
+
+    if (slot_is_read)
+        on_bit_transmitted();
+    else
+        on_bit_received(duration < WRITE_SAMPLE_US ? 1 : 0, now_us);
+}
+
+void Ds18b20::on_reset(uint64_t now_us)
+{
+    update_conversion(now_us);
+    state = RomCommand;
+    rx_byte = rx_bits = rx_count = 0;
+    tx_len = tx_pos = 0;
+    pull_from_us = now_us + PRESENCE_DELAY_US;
+    pull_until_us = pull_from_us + PRESENCE_US;
+}
+
+void Ds18b20::on_bit_received(uint8_t bit, uint64_t now_us)
+{
+    if (state == SearchRom) {
+        // Мастер выбрал направление поиска: если оно не совпало с нашим
+        // битом, выходим из поиска до следующего сброса.
+        const uint8_t own = (rom_code[search_bit / 8] >> (search_bit % 8)) & 1;
+        if (bit != own) {
+            state = Inactive;
+            return;
+        }
+        search_phase = 0;
+        if (++search_bit == 64)
+            state = FunctionCommand;
+        return;
+    }
+
+    if (state != RomCommand && state != MatchRom && state != FunctionCommand && state != ReceiveData)
+        return;
+
+    rx_byte |= bit << rx_bits;
+    if (++rx_bits < 8)
+        return;
+
+    const uint8_t value = rx_byte;
+    rx_byte = rx_bits = 0;
+    on_byte_received(value, now_us);
+}
+
+void Ds18b20::on_byte_received(uint8_t value, uint64_t now_us)
+{
+    switch (state) {
+        case RomCommand:
+            switch (value) {
+                case CMD_SEARCH_ROM:
+                    state = SearchRom;
+                    search_bit = search_phase = 0;
+                    break;
+                case CMD_READ_ROM:
+                    start_transmit(rom_code, 8);
+                    break;
+                case CMD_MATCH_ROM:
+                    state = MatchRom;
+                    rx_count = 0;
+                    break;
+                case CMD_SKIP_ROM:
+                    state = FunctionCommand;
+                    break;
+                case CMD_ALARM_SEARCH:
+                    // В поиске по тревоге участвуют только устройства,
+                    // у которых последнее измерение вышло за пороги.
+                    update_conversion(now_us);
+                    state = alarm ? SearchRom : Inactive;
+                    search_bit = search_phase = 0;
+                    break;
+                default:
+                    state = Inactive;
+            }
+            break;
+
+        case MatchRom:
+            if (value != rom_code[rx_count])
+                state = Inactive;
+            else if (++rx_count == 8)
+                state = FunctionCommand;
+            break;
+
+        case FunctionCommand:
+            update_conversion(now_us);
+            switch (value) {
+                case CMD_CONVERT_T:
+                    converting = true;
+                    conversion_end_us = now_us + ((uint64_t) CONVERSION_9BIT_US << resolution_shift());
+                    state = ConversionStatus;
+                    break;
+                case CMD_READ_SCRATCHPAD:
+                    start_transmit(scratchpad, 9);
+                    if (scratchpad_hook != NULL)
+                        scratchpad_hook(tx_buf, scratchpad_context);
+                    break;
+                case CMD_WRITE_SCRATCHPAD:
+                    state = ReceiveData;
+                    rx_count = 0;
+                    break;
+                case CMD_COPY_SCRATCHPAD:
+                    memcpy(eeprom, scratchpad + SP_TH, sizeof(eeprom));
+                    state = Inactive;
+                    break;
+                case CMD_RECALL_EEPROM:
+                    memcpy(scratchpad + SP_TH, eeprom, sizeof(eeprom));
+                    scratchpad[SP_CRC] = dallas_crc8(scratchpad, 8);
+                    // Копирование мгновенное: на слоты чтения сразу единицы.
+                    start_transmit(NULL, 0);
+                    break;
+                case CMD_READ_POWER_SUPPLY: {
+                    // Датчик на паразитном питании отвечает нулём.
+                    const uint8_t zero = 0;
+                    start_transmit(&zero, parasite ? 1 : 0);
+                    break;
+                }
+                default:
+                    state = Inactive;
+            }
+            break;
+
+        case ReceiveData:
+            // Запись TH, TL и регистра конфигурации. Неизменяемые биты
+            // конфигурации всегда читаются как единицы и нули соответственно.
+            if (rx_count == 2)
+                value = (value & 0x60) | 0x1F;
+            scratchpad[SP_TH + rx_count] = value;
+            if (++rx_count == 3) {
+                scratchpad[SP_CRC] = dallas_crc8(scratchpad, 8);
+                state = Inactive;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+void Ds18b20::start_transmit(const uint8_t *data, uint8_t len)
+{
+    if (len > sizeof(tx_buf))
+        len = sizeof(tx_buf);
+    if (len)
+        memcpy(tx_buf, data, len);
+    tx_len = len;
+    tx_pos = 0;
+    state = TransmitData;
+}
+
+uint8_t Ds18b20::next_tx_bit(uint64_t now_us)
+{
+    if (state == SearchRom) {
+        const uint8_t own = (rom_code[search_bit / 8] >> (search_bit % 8)) & 1;
+        return search_phase == 0 ? own : !own;
+    }
+
+    if (state == ConversionStatus) {
+        update_conversion(now_us);
+        // На паразитном питании датчик не может тянуть линию.
+        return converting && !parasite ? 0 : 1;
+    }
+
+    // После конца буфера линия остаётся свободной - читаются единицы.
+    if (tx_pos >= tx_len * 8)
+        return 1;
+    return (tx_buf[tx_pos / 8] >> (tx_pos % 8)) & 1;
+}
+
+void Ds18b20::on_bit_transmitted(void)
+{
+    if (state == SearchRom)
+        search_phase++;
+    else if (state == TransmitData && tx_pos < tx_len * 8)
+        tx_pos++;
+}
+
+void Ds18b20::update_conversion(uint64_t now_us)
+{
+    if (converting && now_us >= conversion_end_us) {
+        converting = false;
+        latch_temperature();
+    }
+}
+
+// 0 для 9 бит ... 3 для 12 бит.
+uint8_t Ds18b20::resolution_shift(void) const
+{
+    return (scratchpad[SP_CONFIG] >> 5) & 0x03;
+}
+
+void Ds18b20::latch_temperature(void)
+{
+    // Температура в единицах 1/16 °C, дополнительный код. При меньшем
+    // разрешении младшие биты не определены - датчик выдаёт в них нули.
+    int16_t raw = (int16_t) lround(temperature * 16.0);
+    raw &= ~((1 << (3 - resolution_shift())) - 1);
+    scratchpad[0] = raw & 0xFF;
+    scratchpad[1] = (raw >> 8) & 0xFF;
+    scratchpad[SP_CRC] = dallas_crc8(scratchpad, 8);
+
+    // Тревога сравнивает целую часть температуры с TH и TL.
+    const int8_t whole = (int8_t) (raw >> 4);
+    alarm = whole >= (int8_t) scratchpad[SP_TH] || whole <= (int8_t) scratchpad[SP_TL];
+}
@@ -0,0 +1,106 @@
+// Модель термодатчика DS18B20 на уровне временных диаграмм шины 1-wire.
+// Подключается к пину через host_attach_pin_device() (или к OneWireBus,
+// если устройств несколько) и отвечает на те же слоты сброса, записи и
+// чтения, что генерирует библиотека OneWire. Поддерживаются поиск ROM и
+// поиск по тревоге, время измерения по разрешению, EEPROM порогов и
+// конфигурации, паразитное питание.
+#ifndef SIM_DS18B20_H
+#define SIM_DS18B20_H
+
+#include <stdint.h>
+
+#include <ArduinoHost.h>
+
+// Семейство DS18B20 в первом байте ROM.
+#define DS18B20_FAMILY (0x28)
+
+// CRC-8 Dallas (полином X^8 + X^5 + X^4 + 1), побитовый расчёт.
+uint8_t dallas_crc8(const uint8_t *data, uint8_t len);
+
+class Ds18b20 : public HostPinDevice
+{
+public:
+    // Серийный номер - 48 бит, из которых собирается ROM с CRC.
+    explicit Ds18b20(uint64_t serial);
+
+    // Температура кристалла датчика, °C. Задаётся моделью сушилки.
+    double temperature;
+    // Паразитное питание: датчик не может отвечать во время измерения,
+    // а любой слот, начатый мастером до его окончания, срывает измерение.
+    bool parasite;
+    // Сколько измерений было сорвано из-за отсутствия питания.
+    unsigned long failed_conversions;
+
+    const uint8_t *rom(void) const { return rom_code; }
+    // Пользовательские байты TH, TL (как DallasTemperature::setUserData),
+    // записанные в EEPROM датчика.
+    void set_user_data(int16_t data);
+
+    // Подмена блокнота, отдаваемого по Read Scratchpad (воспроизведение
+    // записанной трассы). Обработчик получает копию текущего блокнота и
+    // может переписать её целиком, собственное состояние датчика не меняется.
+    typedef void (*ScratchpadHook)(uint8_t scratchpad[9], void *context);
+    void set_scratchpad_hook(ScratchpadHook hook, void *context)
+    {
+        scratchpad_hook = hook;
+        scratchpad_context = context;
+    }
+
+    void master_changed(bool low, uint64_t now_us);
+    bool pulls_low(uint64_t now_us);
+
+private:
+    // Чего датчик ждёт от мастера в следующем слоте.
+    enum State
+    {
+        Inactive, // Не выбран, ждёт сброса.
+        RomCommand, // Приём ROM-команды.
+        MatchRom, // Приём адреса для Match ROM.
+        SearchRom, // Поиск: бит, инверсный бит, направление.
+        FunctionCommand, // Приём функциональной команды.
+        ReceiveData, // Приём данных Write Scratchpad.
+        TransmitData, // Передача буфера.
+        ConversionStatus, // Передача признака окончания измерения.
+    };
+
+    void on_reset(uint64_t now_us);
+    void on_bit_received(uint8_t bit, uint64_t now_us);
+    void on_byte_received(uint8_t value, uint64_t now_us);
+    uint8_t next_tx_bit(uint64_t now_us);
+    void on_bit_transmitted(void);
+    void start_transmit(const uint8_t *data, uint8_t len);
+    void update_conversion(uint64_t now_us);
+    uint8_t resolution_shift(void) const;
+    void latch_temperature(void);
+
+    uint8_t rom_code[8];
+    uint8_t scratchpad[9];
+    ScratchpadHook scratchpad_hook;
+    void *scratchpad_context;
+    // TH, TL и регистр конфигурации в EEPROM.
+    uint8_t eeprom[3];
+    // Флаг тревоги по результату последнего измерения.
+    bool alarm;
+
+    State state;
+    uint64_t fall_us;
+    bool slot_is_read;
+    uint64_t pull_from_us;
+    uint64_t pull_until_us;
+
+    uint8_t rx_byte;
+    uint8_t rx_bits;
+    uint8_t rx_count;
+
+    uint8_t tx_buf[9];
+    uint8_t tx_len;
+    uint8_t tx_pos;
+
+    uint8_t search_bit;
+    uint8_t search_phase;
+
+    bool converting;
+    uint64_t conversion_end_us;
+};
+
+#endif // SIM_DS18B20_H
@@ -0,0 +1,287 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <ArduinoHost.h>
+
+#include "thermostat.h"
+#include "scenarios.h"
+#include "user_input.h"
+
+// Прогонов на профиль и жестов в прогоне.
+#define FUZZ_RUNS (20)
+#define FUZZ_GESTURES (40)
+// Сколько ждать после последнего жеста, мс.
+#define FUZZ_TAIL_MS (2000)
+// Распознанное действие засчитывается жесту, если оно пришло не позже, мс.
+#define MATCH_WINDOW_MS (1500)
+
+#define MAX_LEVELS (FUZZ_GESTURES * 64)
+
+// Параметры генератора сигналов для одного профиля.
+struct FuzzProfile
+{
+    const char *name;
+    // Интервал между началами жестов, мс.
+    unsigned long period_min;
+    unsigned long period_max;
+    // Сколько замкнут каждый контакт энкодера (или кнопка), мс.
+    unsigned long contact_min;
+    unsigned long contact_max;
+    // Сколько лишних переключений добавляет дребезг на каждом фронте.
+    int bounces;
+    // Шум АЦП, отсчётов (среднеквадратичное).
+    double noise;
+    // Разброс делителя: все уровни умножаются на 1 +- drift.
+    double drift;
+    // Доли нажатий кнопки и недокрученных щелчков (один контакт
+    // замкнулся и разомкнулся - действия быть не должно).
+    double press_ratio;
+    double half_step_ratio;
+};
+
+static const FuzzProfile profiles[] = {
+    { "clean", 400, 600, 5, 15, 0, 0, 0, 0.2, 0 },
+    { "slow", 1200, 2000, 60, 150, 0, 0, 0, 0, 0 },
+    { "fast", 30, 80, 2, 6, 0, 0, 0, 0, 0 },
+    { "bounce", 400, 600, 5, 15, 4, 0, 0, 0.2, 0 },
+    { "noise", 400, 600, 5, 15, 0, 3.0, 0, 0.2, 0 },
+    { "drift-0.5%", 400, 600, 5, 15, 0, 0, 0.005, 0.2, 0 },
+    { "drift-1%", 400, 600, 5, 15, 0, 0, 0.01, 0.2, 0 },
+    { "half-steps", 400, 600, 5, 15, 0, 0, 0, 0, 0.3 },
+    { "mixed", 150, 600, 3, 40, 2, 1.5, 0.003, 0.2, 0.1 },
+};
+
+struct Level
+{
+    unsigned long at_ms;
+    int value;
+};
+
+struct Gesture
+{
+    unsigned long at_ms;
+    UserInputAction action;
+};
+
+struct Decoded
+{
+    unsigned long at_ms;
+    UserInputAction action;
+};
+
+static uint64_t rng_state = 1;
+
+static uint32_t next_random(void)
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t) ((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static unsigned long random_between(unsigned long low, unsigned long high)
+{
+    return low + next_random() % (high - low + 1);
+}
+
+static double random_unit(void)
+{
+    return next_random() / 4294967296.0;
+}
+
+// Приблизительно нормальное распределение (сумма 12 равномерных).
+static double random_gaussian(void)
+{
+    double sum = 0;
+    for (int i = 0; i < 12; i++)
+        sum += random_unit();
+    return sum - 6.0;
+}
+
+static Level levels[MAX_LEVELS];
+static size_t level_count = 0;
+static size_t level_pos = 0;
+static Gesture gestures[FUZZ_GESTURES];
+static size_t gesture_count = 0;
+static Decoded decoded[FUZZ_GESTURES * 4];
+static size_t decoded_count = 0;
+
+static const FuzzProfile *profile = NULL;
+static double scale = 1.0;
+static int nominal = 0;
+static unsigned long end_ms = 0;
+
+static void add_level(unsigned long at_ms, int value)
+{
+    if (level_count < MAX_LEVELS)
+        levels[level_count++] = { at_ms, value };
+}
+
+// Фронт с дребезгом: уровень несколько раз возвращается к прежнему
+// в первые миллисекунды после переключения.
+static void add_edge(unsigned long at_ms, int from, int to)
+{
+    add_level(at_ms, to);
+    for (int i = 0; i < profile->bounces; i++) {
+        const unsigned long t = at_ms + 1 + 2 * i;
+        add_level(t, from);
+        add_level(t + random_between(0, 1) + 1, to);
+    }
+}
+
+// Длительность фронта с дребезгом, мс.
+static unsigned long edge_span(void)
+{
+    return profile->bounces ? 2 * profile->bounces + 2 : 0;
+}
+
+static unsigned long contact(void)
+{
+    return random_between(profile->contact_min, profile->contact_max) + edge_span();
+}
+
+static void generate(void)
+{
+    level_count = level_pos = gesture_count = decoded_count = 0;
+    scale = 1.0 + profile->drift * (2 * random_unit() - 1);
+    nominal = 0;
+
+    unsigned long t = INPUT_START_MS;
+    for (int i = 0; i < FUZZ_GESTURES; i++) {
+        const double kind = random_unit();
+        unsigned long at = t;
+
+        if (kind < profile->press_ratio) {
+            gestures[gesture_count++] = { at, ActionConfirm };
+            add_edge(at, 0, ADC_CONFIRM);
+            at += random_between(60, 200) + edge_span();
+            add_edge(at, ADC_CONFIRM, 0);
+        } else {
+            // Вращение: Next - сначала контакт с уровнем ADC_NEXT, затем ADC_PREV.
+            const bool next = next_random() & 1;
+            const int first = next ? ADC_NEXT : ADC_PREV;
+            const int second = next ? ADC_PREV : ADC_NEXT;
+            if (kind < profile->press_ratio + profile->half_step_ratio) {
+                add_edge(at, 0, first);
+                at += contact();
+                add_edge(at, first, 0);
+            } else {
+                gestures[gesture_count++] = { at, next ? ActionNext : ActionPrev };
+                add_edge(at, 0, first);
+                at += contact();
+                add_edge(at, first, second);
+                at += contact();
+                add_edge(at, second, 0);
+            }
+        }
+
+        const unsigned long period = random_between(profile->period_min, profile->period_max);
+        t = at + 1 > t + period ? at + 1 : t + period;
+    }
+    end_ms = t + FUZZ_TAIL_MS;
+}
+
+static void on_tick(void)
+{
+    const unsigned long now = millis();
+
+    while (level_pos < level_count && levels[level_pos].at_ms <= now)
+        nominal = levels[level_pos++].value;
+
+    double value = nominal * scale;
+    if (profile->noise > 0)
+        value += profile->noise * random_gaussian();
+    host_set_analog(USER_INPUT_PIN, (int) constrain(lround(value), 0L, 1023L));
+
+    if (now >= end_ms)
+        throw SimulationDone();
+}
+
+struct FuzzTotals
+{
+    unsigned long gestures;
+    unsigned long missed;
+    unsigned long spurious;
+    unsigned long matched;
+    double latency_sum;
+    unsigned long latency_max;
+};
+
+// Сопоставление распознанных действий с жестами по порядку: действие
+// засчитывается ближайшему следующему жесту того же вида в окне
+// MATCH_WINDOW_MS, пропущенные по дороге жесты считаются потерянными.
+static void score(FuzzTotals &totals)
+{
+    size_t next = 0;
+    totals.gestures += gesture_count;
+
+    for (size_t d = 0; d < decoded_count; d++) {
+        size_t g = next;
+        while (g < gesture_count && gestures[g].at_ms <= decoded[d].at_ms
+            && (decoded[d].at_ms - gestures[g].at_ms > MATCH_WINDOW_MS || gestures[g].action != decoded[d].action))
+            g++;
+        if (g < gesture_count && gestures[g].at_ms <= decoded[d].at_ms) {
+            const unsigned long latency = decoded[d].at_ms - gestures[g].at_ms;
+            totals.missed += g - next;
+            totals.matched++;
+            totals.latency_sum += latency;
+            if (latency > totals.latency_max)
+                totals.latency_max = latency;
+            next = g + 1;
+        } else {
+            totals.spurious++;
+        }
+    }
+    totals.missed += gesture_count - next;
+}
+
+static void run_once(void)
+{
+    generate();
+
+    host_reset();
+    host_set_tick_handler(on_tick);
+    // Как в setup(): уровни входа из EEPROM (стёртой - значит номинальные).
+    load_calibration();
+    input_event_occurred = false;
+    // Как в setup(): прерывание по изменению уровня на входе энкодера.
+    PCICR |= (1 << PCIE1);
+    PCMSK1 |= (1 << PC0);
+
+    // Проверяется сам декодер: жесты из poll_gesture() склеивали бы
+    // нажатия со следующими за ними щелчками.
+    try {
+        for (;;) {
+            const UserInputAction action = poll_action();
+            if (action != NoAction && decoded_count < sizeof(decoded) / sizeof(decoded[0]))
+                decoded[decoded_count++] = { millis(), action };
+            delay(1);
+        }
+    } catch (const SimulationDone &) {
+    }
+}
+
+int run_encoder_fuzz(unsigned long seed)
+{
+    printf("seed %lu, %d runs x %d gestures per profile\n", seed, FUZZ_RUNS, FUZZ_GESTURES);
+    printf("%-12s %8s %8s %8s %12s %12s\n", "profile", "gestures", "missed", "spurious", "latency avg", "latency max");
+
+    for (size_t p = 0; p < sizeof(profiles) / sizeof(profiles[0]); p++) {
+        profile = &profiles[p];
+        rng_state = (seed + 1) * 0x9E3779B97F4A7C15ULL + p;
+
+        FuzzTotals totals;
+        memset(&totals, 0, sizeof(totals));
+        for (int run = 0; run < FUZZ_RUNS; run++) {
+            run_once();
+            score(totals);
+        }
+
+        printf("%-12s %8lu %8lu %8lu %9.0f ms %9lu ms\n", profile->name, totals.gestures, totals.missed,
+            totals.spurious, totals.matched ? totals.latency_sum / totals.matched : 0.0, totals.latency_max);
+    }
+    return 0;
+}
@@ -0,0 +1,374 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <ArduinoHost.h>
+
+#include "thermostat.h"
+#include "scenarios.h"
+#include "testbed.h"
+#include "user_input.h"
+
+// Пластик, на котором проверяются все случаи (ABS, 60 °C).
+#define FAULT_FILAMENT (1)
+// Сколько наблюдать после паники: нагреватель должен оставаться выключенным.
+#define HOLD_MS (5000)
+// Насколько камера может перегреться относительно уставки, °C.
+#define OVERHEAT_MARGIN (10.0)
+// После сбоя, на который прошивка не должна реагировать паникой,
+// температура должна вернуться в эту полосу вокруг уставки, °C.
+#define RECOVERY_BAND (3.0)
+// Попытка снять панику: через RETRY_AFTER_MS после неё короткое нажатие
+// (заглушить сигнал), ещё через столько же - удержание кнопки
+// RETRY_HOLD_MS. Наблюдение в таких случаях длится RETRY_WATCH_MS.
+#define RETRY_AFTER_MS (1000)
+#define RETRY_HOLD_MS (2000)
+#define RETRY_WATCH_MS (10000)
+// Ожидается паника с любой причиной.
+#define ANY_PANIC "*"
+
+// Коды завершения дочернего процесса.
+#define CASE_PASSED (0)
+#define CASE_FAILED (1)
+#define CASE_KNOWN_GAP (3)
+#define CASE_FIXED_GAP (4)
+
+enum FaultKind
+{
+    FaultCrc, // Блокнот с неверной CRC.
+    FaultValue, // Датчик выдаёт заданную температуру (с верной CRC).
+    FaultStuck, // Показания замерли на значении в момент сбоя.
+    FaultDropout, // Датчик пропал с шины.
+    FaultLcdNak, // Дисплей не подтверждает адрес на шине I2C.
+    FaultSsrShort, // Пробой твердотельного реле: нагреватель включён всегда.
+    FaultHeaterOpen, // Обрыв цепи нагревателя: он не греет никогда.
+};
+
+// Чем должна закончиться попытка снять панику.
+enum RetryOutcome
+{
+    RetryNone, // Панику не пытаются снять.
+    RetryRecovers, // Причина устранена: сушилка возвращается в меню.
+    RetryRefused, // Паника остаётся, отсекающее реле разомкнуто.
+};
+
+struct FaultCase
+{
+    const char *name;
+    FaultKind kind;
+    // Сбой вносится через inject_delay_ms после перехода в эту стадию.
+    HeatingStage inject_stage;
+    unsigned long inject_delay_ms;
+    // Сколько длится сбой: мс для шин, прочитанных блокнотов для
+    // сбоев данных. 0 - до конца прогона.
+    unsigned long duration;
+    // Температура для FaultValue, °C.
+    double value;
+    // Ожидаемая причина паники (NULL - паники быть не должно) и за
+    // сколько она должна случиться. Без паники - сколько наблюдать.
+    const char *panic;
+    unsigned long max_detect_ms;
+    // Прошивка пока не справляется с этим сбоем: провал ожидаем.
+    bool known_gap;
+    RetryOutcome retry;
+    // Сбой вне сушки: в меню (стадия Idle, пластик не выбирается) или
+    // через inject_delay_ms после окончания сушки (стадия Working).
+    // Нагреватель должен оставаться обесточенным.
+    bool outside_run;
+};
+
+static const FaultCase cases[] = {
+    { "crc-error", FaultCrc, Working, 60000, 1, 0, "Temp NaN.", 2000, false, RetryNone, false },
+    { "crc-error-preheat", FaultCrc, PreHeating, 60000, 1, 0, "Temp NaN.", 2000, false, RetryNone, false },
+    { "dropout", FaultDropout, Working, 60000, 2000, 0, "Temp NaN.", 2000, false, RetryRecovers, false },
+    { "dropout-preheat", FaultDropout, PreHeating, 60000, 2000, 0, "Temp NaN.", 2000, false, RetryNone, false },
+    { "glitch-120", FaultValue, Working, 60000, 1, 120.0, NULL, 600000, false, RetryNone, false },
+    { "glitch-0.5", FaultValue, Working, 60000, 1, 0.5, NULL, 600000, false, RetryNone, false },
+    { "reads-120", FaultValue, Working, 60000, 0, 120.0, "Burned.", 5000, false, RetryRefused, false },
+    { "reads-0.5", FaultValue, Working, 60000, 0, 0.5, "Frozen.", 5000, false, RetryNone, false },
+    { "power-on-85", FaultValue, Working, 60000, 1, 85.0, NULL, 600000, false, RetryNone, false },
+    { "stuck-preheat", FaultStuck, PreHeating, 60000, 0, 0, "Preheating.", 3600000, true, RetryNone, false },
+    { "stuck-working", FaultValue, Working, 60000, 0, 55.0, ANY_PANIC, 600000, true, RetryNone, false },
+    { "ssr-short", FaultSsrShort, Working, 60000, 0, 0, "Heater stuck on.", 600000, false, RetryRefused, false },
+    { "ssr-short-menu", FaultSsrShort, Idle, 60000, 0, 0, NULL, 600000, false, RetryNone, true },
+    { "ssr-short-finished", FaultSsrShort, Working, 10000, 0, 0, NULL, 600000, false, RetryNone, true },
+    { "ssr-short-preheat", FaultSsrShort, PreHeating, 60000, 0, 0, "Heater stuck on.", 1800000, false, RetryNone, false },
+    { "lcd-nak", FaultLcdNak, Working, 60000, 60000, 0, NULL, 600000, false, RetryNone, false },
+    { "lcd-missing", FaultLcdNak, Idle, 0, 0, 0, NULL, 3600000, false, RetryNone, false },
+    { "sensor-missing", FaultDropout, Idle, 0, 0, 0, "Temp NaN.", 5000, false, RetryNone, false },
+    { "heater-open", FaultHeaterOpen, Idle, 0, 0, 0, "No heat.", 45000, false, RetryNone, false },
+    { "heater-open-retry", FaultHeaterOpen, Idle, 0, 0, 0, "No heat.", 45000, false, RetryRefused, false },
+};
+
+// Состояние одного прогона (в дочернем процессе).
+static const FaultCase *current = NULL;
+static Testbed *bed = NULL;
+
+static int last_stage = -1;
+static unsigned long stage_ms = 0;
+static bool injected = false;
+static bool fault_active = false;
+static unsigned long inject_ms = 0;
+static unsigned long reads_after = 0;
+static unsigned long faulty_reads = 0;
+static uint8_t stuck_raw[2];
+// С какого момента нагреватель выключен и больше не включался.
+static long heater_off_since = -1;
+static long panic_ms = -1;
+// Причина первой паники: после её снятия panic_reason снова NULL.
+static const char *first_panic = NULL;
+static PanicCode first_code = NoPanic;
+static bool recovered = false;
+static bool heater_on_after_panic = false;
+static unsigned long toggles_after = 0;
+static int last_heater = LOW;
+static double max_chamber = -1000;
+// Когда сушка закончилась и сколько нагреватель был под током после сбоя.
+static long finish_ms = -1;
+static unsigned long powered_ms = 0;
+
+static void set_raw(uint8_t scratchpad[9], int16_t raw)
+{
+    scratchpad[0] = raw & 0xFF;
+    scratchpad[1] = (raw >> 8) & 0xFF;
+    scratchpad[8] = dallas_crc8(scratchpad, 8);
+}
+
+static void on_read_scratchpad(uint8_t scratchpad[9], void *context)
+{
+    (void) context;
+    if (!injected)
+        return;
+    reads_after++;
+    if (!fault_active)
+        return;
+
+    switch (current->kind) {
+        case FaultCrc:
+            scratchpad[0] ^= 0x01;
+            break;
+        case FaultValue:
+            set_raw(scratchpad, (int16_t) lround(current->value * 16.0));
+            break;
+        case FaultStuck:
+            set_raw(scratchpad, (int16_t) (stuck_raw[0] | stuck_raw[1] << 8));
+            break;
+        default:
+            return;
+    }
+    if (current->duration && ++faulty_reads >= current->duration)
+        fault_active = false;
+}
+
+static void set_fault(bool active)
+{
+    fault_active = active;
+    if (current->kind == FaultDropout)
+        host_attach_pin_device(SENSOR_PIN, active ? NULL : &bed->bus);
+    if (current->kind == FaultLcdNak)
+        bed->lcd.nak = active;
+}
+
+// Нагреватель греет, если замкнуты оба реле, включённые
+// последовательно: твердотельное (или пробитое) и отсекающее, и цепь
+// нагревателя цела.
+static bool heater_powered(int heater)
+{
+    if (fault_active && current->kind == FaultHeaterOpen)
+        return false;
+    const bool shorted = fault_active && current->kind == FaultSsrShort;
+    return (heater == HIGH || shorted) && host_pin_output(CUTOFF_PIN) == HIGH;
+}
+
+static void inject(unsigned long now)
+{
+    injected = true;
+    inject_ms = now;
+    if (current->kind == FaultStuck) {
+        const int16_t raw = (int16_t) lround(bed->plant.sensor() * 16.0);
+        stuck_raw[0] = raw & 0xFF;
+        stuck_raw[1] = (raw >> 8) & 0xFF;
+    }
+    if (host_pin_output(HEATER_PIN) == LOW)
+        heater_off_since = now;
+    set_fault(true);
+}
+
+static void on_tick(void)
+{
+    const unsigned long now = millis();
+    const int heater = host_pin_output(HEATER_PIN);
+
+    apply_inputs(now);
+
+    if (bed->step(now, heater_powered(heater))) {
+        if (injected && heater_powered(heater))
+            powered_ms += PLANT_STEP_MS;
+        if (injected && bed->plant.chamber() > max_chamber)
+            max_chamber = bed->plant.chamber();
+    }
+
+    if (heating_stage != last_stage) {
+        last_stage = heating_stage;
+        stage_ms = now;
+    }
+
+    if (finish_ms < 0 && heating_stage == Working && seconds > target_time_sec)
+        finish_ms = now;
+
+    // После окончания сушки задержка отсчитывается от него.
+    const bool after_finish = current->outside_run && current->inject_stage == Working;
+    const unsigned long since_ms = after_finish ? (unsigned long) finish_ms : stage_ms;
+    if (!injected && heating_stage == current->inject_stage && (!after_finish || finish_ms >= 0)
+        && now - since_ms >= current->inject_delay_ms)
+        inject(now);
+
+    if (injected && fault_active && current->duration && current->kind >= FaultDropout
+        && now - inject_ms >= current->duration)
+        set_fault(false);
+
+    if (injected && heater != last_heater) {
+        toggles_after++;
+        heater_off_since = heater == LOW ? (long) now : -1;
+    }
+    last_heater = heater;
+
+    if (panic_reason != NULL && panic_ms < 0) {
+        panic_ms = now;
+        first_panic = panic_reason;
+        first_code = panic_code;
+        if (current->retry != RetryNone) {
+            schedule_press(now + RETRY_AFTER_MS);
+            schedule_input(now + 2 * RETRY_AFTER_MS, ADC_CONFIRM);
+            schedule_input(now + 2 * RETRY_AFTER_MS + RETRY_HOLD_MS, 0);
+        }
+    }
+    if (panic_ms >= 0 && panic_reason == NULL)
+        recovered = true;
+    if (panic_ms >= 0 && heater == HIGH)
+        heater_on_after_panic = true;
+
+    const unsigned long watch_ms = current->retry != RetryNone ? RETRY_WATCH_MS : HOLD_MS;
+    if (panic_ms >= 0 && now - panic_ms >= watch_ms)
+        throw SimulationDone();
+    if (injected && now - inject_ms >= current->max_detect_ms + HOLD_MS)
+        throw SimulationDone();
+}
+
+// Несовпадения с ожиданиями копятся и печатаются после строки итога.
+static char mismatches[256];
+
+static bool check(bool condition, const char *what)
+{
+    if (!condition) {
+        const size_t used = strlen(mismatches);
+        snprintf(mismatches + used, sizeof(mismatches) - used, "        expected %s\n", what);
+    }
+    return condition;
+}
+
+static void format_ms(char *buf, size_t size, long value)
+{
+    if (value < 0)
+        snprintf(buf, size, "-");
+    else
+        snprintf(buf, size, "%ld", value);
+}
+
+static int run_case(const void *arg)
+{
+    current = (const FaultCase *) arg;
+    const double setpoint = filaments[FAULT_FILAMENT].temp;
+
+    Testbed testbed;
+    bed = &testbed;
+    bed->probe.set_scratchpad_hook(on_read_scratchpad, NULL);
+    bed->attach(on_tick);
+    host_erase_eeprom();
+    // Неисправность с самого начала: её должна найти самопроверка. Если
+    // она кончается паникой, меню не будет, и пластик не выбирается:
+    // щелчки в меню смешались бы с попыткой снять панику.
+    const bool at_power_on = current->inject_stage == Idle && current->inject_delay_ms == 0;
+    const bool menu_reached = !(at_power_on && current->panic != NULL);
+    if (menu_reached && (!current->outside_run || current->inject_stage != Idle))
+        schedule_filament_choice(FAULT_FILAMENT);
+    if (at_power_on)
+        inject(0);
+
+    run_firmware();
+
+    bool ok = true;
+    const char *const expected = current->panic;
+    if (expected == NULL && current->outside_run) {
+        ok &= check(panic_reason == NULL, "no panic");
+        ok &= check(injected, "the fault injected");
+        ok &= check(powered_ms == 0, "heater unpowered outside a run");
+        ok &= check(host_pin_output(CUTOFF_PIN) == LOW, "cutoff relay open outside a run");
+    } else if (expected == NULL) {
+        ok &= check(panic_reason == NULL, "no panic");
+        ok &= check(toggles_after > 0, "heater control to continue");
+        ok &= check(fabs(bed->plant.chamber() - setpoint) <= RECOVERY_BAND, "chamber back at the setpoint");
+    } else {
+        char what[64];
+        snprintf(what, sizeof(what), "panic \"%s\" within %lu s", expected, current->max_detect_ms / 1000);
+        const bool reason_ok = first_panic != NULL && (!strcmp(expected, ANY_PANIC) || !strcmp(first_panic, expected));
+        ok &= check(reason_ok && panic_ms >= 0 && panic_ms - inject_ms <= current->max_detect_ms, what);
+        if (panic_ms >= 0)
+            ok &= check(!heater_on_after_panic && host_pin_output(HEATER_PIN) == LOW, "heater off after panic");
+        FaultRecord record;
+        if (panic_ms >= 0)
+            ok &= check(read_fault(0, &record) && record.code == first_code && !read_fault(1, &record),
+                "the panic in the fault log");
+        PostMortem trace;
+        if (panic_ms >= 0) {
+            const bool saved = read_postmortem(&trace);
+            const PostMortemEvent &newest = trace.events[(trace.head + POSTMORTEM_EVENTS - 1) % POSTMORTEM_EVENTS];
+            ok &= check(saved && trace.reason == first_code && newest.kind == EventPanic && newest.data == first_code,
+                "the panic at the end of the post-mortem trace");
+        }
+        if (panic_ms >= 0)
+            ok &= check(host_pin_output(CUTOFF_PIN) == LOW, "cutoff relay open after panic");
+        if (current->retry != RetryNone)
+            ok &= check(host_pin_output(BEEPER_PIN) == LOW, "alarm silenced by a press");
+        if (current->retry == RetryRecovers) {
+            ok &= check(recovered && strchr(bed->lcd.line(0), '?') != NULL, "recovery to the menu after a long press");
+        }
+        if (current->retry == RetryRefused)
+            ok &= check(!recovered, "panic kept after a long press");
+    }
+    ok &= check(max_chamber <= setpoint + OVERHEAT_MARGIN, "no overheating");
+
+    int code = ok ? CASE_PASSED : CASE_FAILED;
+    if (current->known_gap)
+        code = ok ? CASE_FIXED_GAP : CASE_KNOWN_GAP;
+    static const char *const verdicts[] = { "  ok  ", "  FAIL", "", "  gap ", "  ok  " };
+
+    char detect[24];
+    char heater_off[24];
+    format_ms(detect, sizeof(detect), panic_ms >= 0 ? panic_ms - (long) inject_ms : -1);
+    format_ms(heater_off, sizeof(heater_off), panic_ms >= 0 && heater_off_since >= 0 ? heater_off_since - (long) inject_ms : -1);
+    printf("%s %-18s panic %-16s detect %7s ms, heater off %7s ms, %4lu reads, chamber max %5.1f *C\n",
+        verdicts[code], current->name, first_panic != NULL ? first_panic : "-", detect, heater_off, reads_after,
+        max_chamber);
+    printf("%s", mismatches);
+    if (code == CASE_FIXED_GAP)
+        printf("        known gap no longer reproduces, update the case table\n");
+    return code;
+}
+
+int run_fault_check(void)
+{
+    int failures = 0;
+    const size_t count = sizeof(cases) / sizeof(cases[0]);
+
+    for (size_t i = 0; i < count; i++) {
+        const int code = run_isolated(run_case, &cases[i]);
+        if (code < 0)
+            printf("  FAIL %-18s crashed\n", cases[i].name);
+        if (code != CASE_PASSED && code != CASE_KNOWN_GAP)
+            failures++;
+    }
+
+    return report_failures(failures);
+}
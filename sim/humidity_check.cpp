@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <ArduinoHost.h>
+
+#include "thermostat.h"
+#include "scenarios.h"
+#include "sht3x.h"
+#include "testbed.h"
+#include "user_input.h"
+
+// Влага в катушке, г.
+#define WET_SPOOL_G (3.0)
+// Через сколько минут сушки отключается датчик в случае "sensor lost".
+#define LOST_AFTER_MIN (30)
+// Решение об окончании прошивка принимает по последнему измерению
+// влажности; к сигналу окончания влажность в камере может подрасти
+// относительно него на столько, %.
+#define RH_TOLERANCE (0.5)
+
+struct HumidityCase
+{
+    int filament_idx;
+    bool lose_sensor; // Отключить датчик во время сушки.
+};
+
+// Состояние прогона одного случая (в дочернем процессе).
+static const HumidityCase *current = NULL;
+static Testbed *bed = NULL;
+static Sht3x *hygrometer = NULL;
+
+static unsigned long working_ms = 0;
+static unsigned long finish_ms = 0;
+static double finish_rh = 0;
+static uint16_t finish_reading = 0;
+static double finish_moisture = 0;
+
+static void on_tick(void)
+{
+    const unsigned long now = millis();
+
+    apply_inputs(now);
+
+    if (bed->step(now, host_pin_output(HEATER_PIN) == HIGH)) {
+        hygrometer->temperature = bed->plant.chamber();
+        hygrometer->humidity = bed->plant.humidity();
+    }
+
+    if (panic_reason != NULL)
+        fail_run(now, panic_reason);
+
+    if (working_ms == 0 && heating_stage == Working)
+        working_ms = now;
+    if (current->lose_sensor && working_ms && now - working_ms >= LOST_AFTER_MIN * 60000UL)
+        hygrometer->nak = true;
+
+    // Окончание сушки прошивка отмечает сигналом пищалки.
+    if (working_ms && host_pin_output(BEEPER_PIN) == HIGH) {
+        finish_ms = now;
+        finish_rh = bed->plant.humidity();
+        finish_reading = chamber_rh;
+        finish_moisture = bed->plant.moisture();
+        throw SimulationDone();
+    }
+
+    if (now > PREHEAT_LIMIT_MS + (filaments[current->filament_idx].time_sec + 600) * 1000UL)
+        fail_run(now, "run did not finish");
+}
+
+static int run_case(const void *arg)
+{
+    current = (const HumidityCase *) arg;
+    const Filament &expected = filaments[current->filament_idx];
+
+    PlantParams params;
+    params.moisture_g = WET_SPOOL_G;
+    Testbed testbed(params);
+    Sht3x hygrometer_model;
+    bed = &testbed;
+    hygrometer = &hygrometer_model;
+    hygrometer->temperature = bed->plant.chamber();
+    hygrometer->humidity = bed->plant.humidity();
+
+    bed->attach(on_tick);
+    host_attach_i2c_device(HUMIDITY_ADDRESS, hygrometer);
+    schedule_filament_choice(current->filament_idx);
+
+    run_firmware();
+
+    if (!humidity_sensor && !current->lose_sensor)
+        note_failure("humidity sensor not detected");
+    if (finish_ms == 0)
+        note_failure("no finish signal");
+
+    const double dried_s = (finish_ms - working_ms) / 1000.0;
+    if (current->lose_sensor) {
+        // Без датчика сушка идёт по времени из профиля.
+        if (humidity_sensor || dried_s < expected.time_sec)
+            note_failure("dried for %.0f s after losing the sensor, expected %lu s", dried_s, expected.time_sec);
+    } else {
+        if (dried_s >= expected.time_sec)
+            note_failure("ran the full %lu s, no humidity plateau", expected.time_sec);
+        else if (finish_reading >= expected.dry_rh * 100U || finish_rh >= expected.dry_rh + RH_TOLERANCE)
+            note_failure("finished at %.1f %% RH (measured %.2f %%), above %u %%", finish_rh, finish_reading / 100.0,
+                expected.dry_rh);
+    }
+    if (bed->lcd.stats().violations)
+        note_failure("LCD timing: %s", bed->lcd.violation(0));
+    if (hygrometer->stats().early_reads)
+        note_failure("%lu SHT3x reads before the measurement ended", hygrometer->stats().early_reads);
+
+    printf("%s %-6s %2d *C %-12s dried %2lu:%02lu:%02lu of %2lu:00:00, %4.1f %% RH (dry %2u %%), %.2f g left, "
+           "%lu measurements\n",
+        run_failure[0] ? "  FAIL" : "  ok  ", expected.name, expected.temp, current->lose_sensor ? "sensor lost" : "",
+        (finish_ms - working_ms) / 3600000, (finish_ms - working_ms) / 60000 % 60,
+        (finish_ms - working_ms) / 1000 % 60, expected.time_sec / 3600, finish_rh, expected.dry_rh, finish_moisture,
+        hygrometer->stats().results);
+    if (run_failure[0])
+        printf("        %s\n", run_failure);
+    return run_failure[0] ? 1 : 0;
+}
+
+int run_humidity_check(void)
+{
+    HumidityCase cases[MAX_PARALLEL_RUNS];
+    int codes[MAX_PARALLEL_RUNS];
+    size_t count = 0;
+    for (size_t i = 0; i < filaments_count && count + 1 < MAX_PARALLEL_RUNS; i++) {
+        cases[count].filament_idx = i;
+        cases[count].lose_sensor = false;
+        count++;
+    }
+    cases[count].filament_idx = 0;
+    cases[count].lose_sensor = true;
+    count++;
+
+    run_isolated_parallel(run_case, cases, sizeof(cases[0]), count, codes);
+    return report_failures(count_failures(codes, count));
+}
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "scenarios.h"
+
+static int exit_code(pid_t pid)
+{
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status))
+        return -1;
+    return WEXITSTATUS(status);
+}
+
+int run_isolated(int (*fn)(const void *arg), const void *arg)
+{
+    fflush(stdout);
+    fflush(stderr);
+
+    const pid_t pid = fork();
+    if (pid < 0)
+        perror("fork");
+    if (pid == 0) {
+        const int code = fn(arg);
+        fflush(stdout);
+        _exit(code);
+    }
+    return exit_code(pid);
+}
+
+void run_isolated_parallel(int (*fn)(const void *arg), const void *args, size_t size, size_t count, int *codes)
+{
+    pid_t pids[MAX_PARALLEL_RUNS];
+    FILE *outputs[MAX_PARALLEL_RUNS];
+
+    fflush(stdout);
+    fflush(stderr);
+
+    // Каждый процесс пишет в свой временный файл, чтобы вывод прогонов
+    // не перемешивался; он печатается по порядку после завершения всех.
+    for (size_t i = 0; i < count && i < MAX_PARALLEL_RUNS; i++) {
+        outputs[i] = tmpfile();
+        pids[i] = outputs[i] != NULL ? fork() : -1;
+        if (pids[i] < 0)
+            perror("fork");
+        if (pids[i] == 0) {
+            dup2(fileno(outputs[i]), STDOUT_FILENO);
+            const int code = fn((const char *) args + i * size);
+            fflush(stdout);
+            _exit(code);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        codes[i] = i < MAX_PARALLEL_RUNS ? exit_code(pids[i]) : -1;
+        if (i >= MAX_PARALLEL_RUNS || outputs[i] == NULL)
+            continue;
+        rewind(outputs[i]);
+        char buffer[4096];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), outputs[i])) > 0)
+            fwrite(buffer, 1, n, stdout);
+        fclose(outputs[i]);
+    }
+}
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "lcd1602.h"
+
+// Биты порта PCF8574.
+#define PIN_RS (0x01)
+#define PIN_RW (0x02)
+#define PIN_E (0x04)
+#define PIN_BACKLIGHT (0x08)
+#define PIN_DATA (0xF0)
+
+// Ожидание после подачи питания до первой команды, мкс.
+#define POWER_ON_US (40000)
+// Время выполнения команд при тактовой 270 кГц, мкс.
+#define EXEC_US (37)
+#define EXEC_DATA_US (41)
+#define EXEC_CLEAR_US (1520)
+// Первые две команды Function Set при инициализации по datasheet
+// (рис. 24): ждать больше 4.1 мс и больше 100 мкс.
+#define EXEC_INIT_FIRST_US (4100)
+#define EXEC_INIT_SECOND_US (100)
+
+// Длина строки DDRAM в двухстрочном режиме и адрес второй строки.
+#define LINE_LENGTH (40)
+#define LINE2_BASE (0x40)
+
+Lcd1602::Lcd1602(uint32_t byte_us)
+    : nak(false)
+    , byte_us(byte_us)
+    , transfer_us(0)
+    , transfer_bytes(0)
+    , port(0xFF)
+    , pending_nibble(false)
+    , four_bit(false)
+    , low_nibble_next(false)
+    , high_nibble(0)
+    , init_steps(0)
+    , busy_until_us(POWER_ON_US)
+    , address(0)
+    , address_cgram(false)
+    , increment(true)
+    , shift_display(false)
+    , display_shift(0)
+    , display_control(0)
+    , function(0)
+{
+    // После подачи питания DDRAM заполнена пробелами.
+    memset(ddram, ' ', sizeof(ddram));
+    memset(cgram, 0, sizeof(cgram));
+    memset(messages, 0, sizeof(messages));
+    reset_stats();
+}
+
+void Lcd1602::reset_stats(void)
+{
+    memset(&counters, 0, sizeof(counters));
+}
+
+bool Lcd1602::start(bool read)
+{
+    (void) read;
+    if (nak)
+        return false;
+    counters.transactions++;
+    transfer_us = host_time_us();
+    transfer_bytes = 0;
+    return true;
+}
+
+bool Lcd1602::write(uint8_t value)
+{
+    counters.bytes++;
+    // Выводы PCF8574 переключаются в конце приёма байта (после адреса
+    // и предыдущих байтов транзакции).
+    transfer_bytes++;
+    on_port(value, transfer_us + (uint64_t) (transfer_bytes + 1) * byte_us);
+    return true;
+}
+
+uint8_t Lcd1602::read(void)
+{
+    return port;
+}
+
+void Lcd1602::on_port(uint8_t value, uint64_t now_us)
+{
+    const uint8_t previous = port;
+    port = value;
+
+    const bool enable_was = previous & PIN_E;
+    const bool enable_is = value & PIN_E;
+
+    if (!enable_was && enable_is) {
+        pending_nibble = false;
+        return;
+    }
+
+    if (enable_was && !enable_is) {
+        // Цикл чтения не меняет состояние контроллера. Такой получается
+        // и при первой записи в расширитель: после включения питания все
+        // выводы PCF8574 в единице.
+        if (previous & PIN_RW)
+            return;
+        // Данные должны быть стабильны к спаду E (время удержания).
+        if ((previous ^ value) & (PIN_DATA | PIN_RS | PIN_RW))
+            flag(now_us, "data changed on the E falling edge");
+        on_nibble(previous & PIN_DATA, previous & PIN_RS, now_us);
+        return;
+    }
+
+    if (enable_is) {
+        if ((previous ^ value) & (PIN_DATA | PIN_RS | PIN_RW))
+            flag(now_us, "data changed while E is high");
+        return;
+    }
+
+    // E = 0: выставлен новый полубайт. Если прежний так и не был
+    // защёлкнут, значит пропущен импульс E. Нулевые данные - это
+    // управление подсветкой, их защёлкивать не нужно.
+    if ((previous ^ value) & (PIN_DATA | PIN_RS)) {
+        if (pending_nibble)
+            flag(now_us, "nibble set up without an enable pulse");
+        pending_nibble = (value & (PIN_DATA | PIN_RS)) != 0;
+    }
+}
+
+void Lcd1602::on_nibble(uint8_t nibble, bool rs, uint64_t now_us)
+{
+    counters.nibbles++;
+
+    if (!four_bit) {
+        // В 8-битном режиме DB0..DB3 не подключены и читаются нулями.
+        execute(nibble, rs, now_us);
+        return;
+    }
+
+    if (!low_nibble_next) {
+        high_nibble = nibble;
+        low_nibble_next = true;
+        // Контроллер занят - первый полубайт новой команды будет потерян.
+        if (now_us < busy_until_us)
+            flag(now_us, "instruction sent while the controller is busy");
+        return;
+    }
+
+    low_nibble_next = false;
+    execute(high_nibble | (nibble >> 4), rs, now_us);
+}
+
+void Lcd1602::execute(uint8_t value, bool rs, uint64_t now_us)
+{
+    if (!four_bit && now_us < busy_until_us)
+        flag(now_us, "instruction sent while the controller is busy");
+
+    if (rs) {
+        counters.characters++;
+        write_data(value);
+        busy_until_us = now_us + EXEC_DATA_US;
+        return;
+    }
+
+    counters.commands++;
+    command(value, now_us);
+}
+
+void Lcd1602::command(uint8_t value, uint64_t now_us)
+{
+    uint32_t exec_us = EXEC_US;
+
+    if (value & 0x80) {
+        // Set DDRAM address.
+        address = value & 0x7F;
+        address_cgram = false;
+    } else if (value & 0x40) {
+        // Set CGRAM address.
+        address = value & 0x3F;
+        address_cgram = true;
+    } else if (value & 0x20) {
+        // Function set: DL, N, F.
+        if (!four_bit && init_steps < 2)
+            exec_us = init_steps++ == 0 ? EXEC_INIT_FIRST_US : EXEC_INIT_SECOND_US;
+        four_bit = !(value & 0x10);
+        function = value;
+    } else if (value & 0x10) {
+        // Cursor or display shift.
+        const bool right = value & 0x04;
+        if (value & 0x08) {
+            display_shift += right ? -1 : 1;
+            display_shift = (display_shift + LINE_LENGTH) % LINE_LENGTH;
+        } else {
+            increment = right;
+            move_address();
+        }
+    } else if (value & 0x08) {
+        display_control = value & 0x07;
+    } else if (value & 0x04) {
+        increment = value & 0x02;
+        shift_display = value & 0x01;
+    } else if (value & 0x02) {
+        // Return home.
+        address = 0;
+        address_cgram = false;
+        display_shift = 0;
+        exec_us = EXEC_CLEAR_US;
+    } else if (value & 0x01) {
+        // Clear display: пробелы, адрес 0, направление - вправо.
+        memset(ddram, ' ', sizeof(ddram));
+        address = 0;
+        address_cgram = false;
+        display_shift = 0;
+        increment = true;
+        exec_us = EXEC_CLEAR_US;
+    }
+
+    busy_until_us = now_us + exec_us;
+}
+
+void Lcd1602::write_data(uint8_t value)
+{
+    if (address_cgram) {
+        cgram[address & 0x3F] = value;
+        address = (address + (increment ? 1 : -1)) & 0x3F;
+        return;
+    }
+
+    ddram[address & 0x7F] = value;
+    move_address();
+    if (shift_display) {
+        display_shift += increment ? 1 : -1;
+        display_shift = (display_shift + LINE_LENGTH) % LINE_LENGTH;
+    }
+}
+
+// Счётчик адреса DDRAM: в двухстрочном режиме строки 0x00..0x27 и
+// 0x40..0x67 переходят одна в другую.
+void Lcd1602::move_address(void)
+{
+    const bool two_lines = function & 0x08;
+
+    if (!two_lines) {
+        address = increment ? (address + 1) % 80 : (address + 79) % 80;
+        return;
+    }
+    if (increment) {
+        if (address == LINE_LENGTH - 1)
+            address = LINE2_BASE;
+        else if (address == LINE2_BASE + LINE_LENGTH - 1)
+            address = 0;
+        else
+            address++;
+    } else {
+        if (address == 0)
+            address = LINE2_BASE + LINE_LENGTH - 1;
+        else if (address == LINE2_BASE)
+            address = LINE_LENGTH - 1;
+        else
+            address--;
+    }
+}
+
+const char *Lcd1602::line(uint8_t row)
+{
+    char *const text = rendered[row % LCD_ROWS];
+    const bool two_lines = function & 0x08;
+
+    for (uint8_t col = 0; col < LCD_COLS; col++) {
+        char c = ' ';
+        if (display_on() && (row == 0 || two_lines)) {
+            const uint8_t length = two_lines ? LINE_LENGTH : 80;
+            const uint8_t offset = (col + display_shift) % length;
+            const uint8_t value = ddram[(row ? LINE2_BASE : 0) + offset];
+            c = value >= 0x20 && value < 0x7F ? value : '?';
+        }
+        text[col] = c;
+    }
+    text[LCD_COLS] = 0;
+    return text;
+}
+
+bool Lcd1602::backlight(void) const
+{
+    return port & PIN_BACKLIGHT;
+}
+
+const char *Lcd1602::violation(uint8_t idx) const
+{
+    if (idx >= LCD_MAX_VIOLATIONS || messages[idx][0] == 0)
+        return NULL;
+    return messages[idx];
+}
+
+void Lcd1602::flag(uint64_t now_us, const char *what)
+{
+    if (counters.violations < LCD_MAX_VIOLATIONS)
+        snprintf(messages[counters.violations], sizeof(messages[0]), "%.3f ms: %s", now_us / 1000.0, what);
+    counters.violations++;
+}
+
+void Lcd1602::print(void)
+{
+    printf("+----------------+\n");
+    for (uint8_t row = 0; row < LCD_ROWS; row++)
+        printf("|%s|\n", line(row));
+    printf("+----------------+%s\n", backlight() ? "" : " (backlight off)");
+}
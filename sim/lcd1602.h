@@ -0,0 +1,95 @@
+// Модель дисплея 1602 с I2C-переходником: расширитель PCF8574 и
+// контроллер HD44780. Подключается к шине через host_attach_i2c_device()
+// и разбирает поток полубайтов LiquidCrystal_I2C в символы на экране
+// 16x2, попутно проверяя временные требования контроллера.
+//
+// Разводка переходника: P0 - RS, P1 - RW, P2 - E, P3 - подсветка,
+// P4..P7 - DB4..DB7. Контроллер защёлкивает данные по спаду E.
+#ifndef SIM_LCD1602_H
+#define SIM_LCD1602_H
+
+#include <stdint.h>
+
+#include <ArduinoHost.h>
+
+#define LCD_COLS (16)
+#define LCD_ROWS (2)
+// Сколько сообщений о нарушениях хранить.
+#define LCD_MAX_VIOLATIONS (8)
+
+struct LcdStats
+{
+    unsigned long transactions; // Транзакций I2C с адресом дисплея.
+    unsigned long bytes; // Записанных в расширитель байтов.
+    unsigned long nibbles; // Защёлкнутых контроллером полубайтов.
+    unsigned long commands; // Выполненных команд.
+    unsigned long characters; // Записанных символов.
+    unsigned long violations; // Нарушений временных диаграмм.
+};
+
+class Lcd1602 : public HostI2cDevice
+{
+public:
+    // byte_us - время передачи байта по I2C (9 бит), по умолчанию 100 кГц.
+    explicit Lcd1602(uint32_t byte_us = 90);
+
+    // Отвечать NAK на адрес (дисплей отключён или неисправен).
+    bool nak;
+
+    bool start(bool read);
+    bool write(uint8_t value);
+    uint8_t read(void);
+
+    // Строка экрана row (0 или 1) с учётом сдвига, LCD_COLS символов.
+    // Пустая строка из пробелов, если дисплей выключен.
+    const char *line(uint8_t row);
+    bool display_on(void) const { return display_control & 0x04; }
+    bool backlight(void) const;
+    const LcdStats &stats(void) const { return counters; }
+    void reset_stats(void);
+    // Сообщения о первых нарушениях, NULL после последнего.
+    const char *violation(uint8_t idx) const;
+    // Печать экрана в рамке.
+    void print(void);
+
+private:
+    void on_port(uint8_t value, uint64_t now_us);
+    void on_nibble(uint8_t nibble, bool rs, uint64_t now_us);
+    void execute(uint8_t value, bool rs, uint64_t now_us);
+    void command(uint8_t value, uint64_t now_us);
+    void write_data(uint8_t value);
+    void move_address(void);
+    void flag(uint64_t now_us, const char *what);
+
+    uint32_t byte_us;
+    uint64_t transfer_us;
+    uint8_t transfer_bytes;
+
+    uint8_t port;
+    // Полубайт выставлен при E = 0 и ещё не защёлкнут.
+    bool pending_nibble;
+
+    bool four_bit;
+    bool low_nibble_next;
+    uint8_t high_nibble;
+    // Сколько команд Function Set в 8-битном режиме уже пришло
+    // (первые две выполняются дольше остальных).
+    uint8_t init_steps;
+    uint64_t busy_until_us;
+
+    uint8_t ddram[0x80];
+    uint8_t cgram[0x40];
+    uint8_t address;
+    bool address_cgram;
+    bool increment;
+    bool shift_display;
+    int8_t display_shift;
+    uint8_t display_control;
+    uint8_t function;
+
+    char rendered[LCD_ROWS][LCD_COLS + 1];
+    LcdStats counters;
+    char messages[LCD_MAX_VIOLATIONS][64];
+};
+
+#endif // SIM_LCD1602_H
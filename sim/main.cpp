@@ -0,0 +1,364 @@
+// Запуск прошивки сушилки на хосте под виртуальными часами.
+// Собирается окружением env:native (см. platformio.ini):
+//   pio run -e native && .pio/build/native/program --help
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <ArduinoHost.h>
+
+#include "thermostat.h"
+#include "scenarios.h"
+#include "sht3x.h"
+#include "testbed.h"
+#include "user_input.h"
+
+// Полуширина полосы, в которой температура считается установившейся, °C.
+#define SETTLE_BAND (1.5)
+// Теплоёмкость нагревателя для --heater-probe, Дж/К.
+#define HEATER_PROBE_CAPACITY (100.0)
+
+// Параметры запуска.
+static double limit_hours = 13;
+static int filament_idx = 0;
+static bool verbose = false;
+static bool show_lcd = false;
+static PlantParams plant_params;
+static const char *replay_path = NULL;
+static unsigned long replay_tolerance_ms = 2000;
+static unsigned long seed = 1;
+static bool encoder_fuzz = false;
+static bool heater_probe = false;
+static bool ambient_probe = false;
+static bool humidity_probe = false;
+// Скачок температуры в помещении: новая температура и через сколько
+// минут сушки (после перехода в Working) он происходит.
+static double ambient_change = 0;
+static double ambient_change_min = -1;
+
+static Testbed *bed = NULL;
+static Plant *plant = NULL;
+static Ds18b20 *surface_probe = NULL;
+static Ds18b20 *room_probe = NULL;
+static OneWireBus *bus = NULL;
+static Lcd1602 *lcd = NULL;
+static Sht3x *hygrometer = NULL;
+
+// Наблюдения за прогоном.
+static int last_heater = -1;
+static int last_stage = -1;
+static bool finished = false;
+static unsigned long preheat_ms = 0;
+static unsigned long working_ms = 0;
+static unsigned long last_outside_ms = 0;
+static unsigned long heater_on_ms = 0;
+static unsigned long working_total_ms = 0;
+static double max_chamber = -1000;
+static double min_chamber = 1000;
+static double max_sensor = -1000;
+static double max_surface = -1000;
+static double min_humidity = 100;
+
+static const char *stage_name(int stage)
+{
+    switch (stage) {
+        case Idle:
+            return "Idle";
+        case PreHeating:
+            return "PreHeating";
+        case Working:
+            return "Working";
+    }
+    return "?";
+}
+
+static void print_time(unsigned long ms)
+{
+    printf("[%2lu:%02lu:%02lu.%03lu] ", ms / 3600000, ms / 60000 % 60, ms / 1000 % 60, ms % 1000);
+}
+
+// Вызывается на каждой виртуальной миллисекунде.
+static void on_tick(void)
+{
+    const unsigned long now = millis();
+
+    apply_inputs(now);
+
+    const int heater = host_pin_output(HEATER_PIN);
+
+    if (bed->step(now, heater == HIGH)) {
+        if (surface_probe != NULL)
+            surface_probe->temperature = plant->heater();
+        if (room_probe != NULL)
+            room_probe->temperature = plant->ambient();
+        if (ambient_change_min >= 0 && working_ms && now - working_ms >= ambient_change_min * 60000
+            && plant->ambient() != ambient_change) {
+            plant->set_ambient(ambient_change);
+            print_time(now);
+            printf("ambient %.1f *C\n", ambient_change);
+        }
+        if (hygrometer != NULL) {
+            hygrometer->temperature = plant->chamber();
+            hygrometer->humidity = plant->humidity();
+        }
+        if (plant->heater() > max_surface)
+            max_surface = plant->heater();
+        if (plant->humidity() < min_humidity)
+            min_humidity = plant->humidity();
+
+        if (heating_stage != Idle && filament != NULL) {
+            if (fabs(plant->chamber() - target_temp) > SETTLE_BAND)
+                last_outside_ms = now;
+        }
+        if (heating_stage == Working) {
+            if (plant->chamber() > max_chamber)
+                max_chamber = plant->chamber();
+            // Провал считается после того, как камера дошла до уставки.
+            if (max_chamber >= target_temp && plant->chamber() < min_chamber)
+                min_chamber = plant->chamber();
+            if (plant->sensor() > max_sensor)
+                max_sensor = plant->sensor();
+            working_total_ms += PLANT_STEP_MS;
+            if (heater == HIGH)
+                heater_on_ms += PLANT_STEP_MS;
+        }
+    }
+
+    if (heater != last_heater) {
+        last_heater = heater;
+        if (verbose) {
+            print_time(now);
+            printf("heater %s, chamber %.2f, sensor %.2f, surface %.2f\n", heater ? "on" : "off", plant->chamber(),
+                plant->sensor(), plant->heater());
+        }
+    }
+
+    if (heating_stage != last_stage) {
+        last_stage = heating_stage;
+        if (last_stage == PreHeating)
+            preheat_ms = now;
+        if (last_stage == Working)
+            working_ms = now;
+        print_time(now);
+        printf("stage %s\n", stage_name(last_stage));
+        if (show_lcd)
+            lcd->print();
+    }
+
+    if (panic_reason != NULL) {
+        print_time(now);
+        printf("panic: %s\n", panic_reason);
+        throw SimulationDone();
+    }
+
+    if (heating_stage == Working && filament != NULL && seconds > target_time_sec) {
+        finished = true;
+        print_time(now);
+        printf("finished\n");
+        throw SimulationDone();
+    }
+
+    if (now >= limit_hours * 3600000)
+        throw SimulationDone();
+}
+
+static void report(void)
+{
+    const double setpoint = filament != NULL ? target_temp : 0;
+
+    printf("\n");
+    printf("filament:      %s, %.0f *C\n", filament != NULL ? filament->name : "-", setpoint);
+    printf("result:        %s\n", panic_reason != NULL ? "panic" : finished ? "finished" : "time limit");
+    if (preheat_ms)
+        printf("preheating:    %.1f min\n", ((working_ms ? working_ms : millis()) - preheat_ms) / 60000.0);
+    if (working_ms) {
+        printf("overshoot:     %+.2f *C (chamber), %+.2f *C (sensor)\n", max_chamber - setpoint, max_sensor - setpoint);
+        if (min_chamber < 1000)
+            printf("undershoot:    %+.2f *C (chamber, after reaching the setpoint)\n", min_chamber - setpoint);
+        printf("settling time: %.1f min (+-%.1f *C)\n", (last_outside_ms - preheat_ms) / 60000.0, SETTLE_BAND);
+        printf("heater duty:   %.1f %%\n", working_total_ms ? 100.0 * heater_on_ms / working_total_ms : 0.0);
+    }
+    printf("heater max:    %.1f *C surface (limit %d *C with a heater probe)\n", max_surface, HEATER_MAX_TEMP);
+    const OneWireStats &stats = bus->stats();
+    printf("1-wire bus:    %lu resets, %lu read + %lu write slots, %.2f %% busy\n", stats.resets,
+        stats.read_slots, stats.write_slots, 100.0 * stats.busy_us / host_time_us());
+    if (plant_params.moisture_g > 0)
+        printf("moisture left: %.2f g of %.2f g\n", plant->moisture(), plant_params.moisture_g);
+    if (hygrometer != NULL) {
+        const Sht3xStats &sht = hygrometer->stats();
+        printf("humidity:      %.1f %% now, %.1f %% min, firmware %s %.2f %% (dry below %u %%)\n", plant->humidity(),
+            min_humidity, humidity_valid ? "reads" : "lost,", chamber_rh / 100.0, filament != NULL ? filament->dry_rh : 0);
+        printf("sht3x:         %lu measurements, %lu results, %lu early reads, %lu bad commands\n", sht.measurements,
+            sht.results, sht.early_reads, sht.bad_commands);
+    }
+    const LcdStats &screen_stats = lcd->stats();
+    printf("lcd:           %lu transactions, %lu bytes, %lu commands, %lu characters, %lu timing violations\n",
+        screen_stats.transactions, screen_stats.bytes, screen_stats.commands, screen_stats.characters,
+        screen_stats.violations);
+    for (uint8_t i = 0; lcd->violation(i) != NULL; i++)
+        printf("               %s\n", lcd->violation(i));
+    if (show_lcd)
+        lcd->print();
+}
+
+static void usage(const char *argv0)
+{
+    printf("Usage: %s [options]\n", argv0);
+    printf("  --filament N    select N-th entry of filaments[] (default 0)\n");
+    printf("  --hours H       stop after H virtual hours (default 13)\n");
+    printf("  --ambient C     room temperature (default %.1f)\n", plant_params.ambient);
+    printf("  --heater W      heater power (default %.0f)\n", plant_params.heater_w);
+    printf("  --sensor-tau S  sensor lag time constant (default %.0f)\n", plant_params.sensor_tau);
+    printf("  --dead-time S   heater to air dead time (default %.0f)\n", plant_params.dead_time);
+    printf("  --moisture G    water in the spool, grams (default 0)\n");
+    printf("  --heater-probe  model the heater element and put a marked DS18B20\n");
+    printf("                  on it (cascade control)\n");
+    printf("  --ambient-probe put a marked DS18B20 in the room (feed-forward)\n");
+    printf("  --humidity-sensor\n");
+    printf("                  put an SHT3x in the chamber (drying ends on a humidity\n");
+    printf("                  plateau)\n");
+    printf("  --ambient-change C MIN\n");
+    printf("                  change the room temperature to C after MIN minutes\n");
+    printf("                  of drying\n");
+    printf("  --verbose       log every heater toggle\n");
+    printf("  --lcd           show the LCD contents on every stage change\n");
+    printf("  --record FILE   write the firmware trace (built with TRACE_RECORDER)\n");
+    printf("  --replay FILE   replay a recorded trace and compare heater toggles\n");
+    printf("  --tolerance MS  allowed heater toggle skew for --replay (default %lu)\n", replay_tolerance_ms);
+    printf("  --postmortem FILE\n");
+    printf("                  decode the event ring from a serial log of the fault\n");
+    printf("                  log screen and exit\n");
+    printf("  --bus-check     verify the OneWire/DallasTemperature stack on a\n");
+    printf("                  simulated multi-device bus and exit\n");
+    printf("  --fault-check   inject sensor and display faults, check the firmware\n");
+    printf("                  reaction and detection time, and exit\n");
+    printf("  --regression    run the full drying cycle of every filament profile\n");
+    printf("                  and check stages, countdown and heater, and exit\n");
+    printf("  --crc-bench     check all OneWire CRC variants for equivalence and\n");
+    printf("                  measure their host throughput, and exit\n");
+    printf("  --encoder-fuzz  feed randomized encoder waveforms to the input decoder,\n");
+    printf("                  report missed/spurious steps and latency, and exit\n");
+    printf("  --seed N        random seed for --encoder-fuzz (default 1)\n");
+    printf("  --humidity-check\n");
+    printf("                  dry a wet spool of every filament with an SHT3x,\n");
+    printf("                  check the humidity endpoint and the shared bus, and exit\n");
+    printf("  --observer      compute the steady-state Kalman gains of the chamber\n");
+    printf("                  observer, report its estimate error, and exit\n");
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        const char *const arg = argv[i];
+        const bool has_value = i + 1 < argc;
+
+        if (!strcmp(arg, "--filament") && has_value) {
+            filament_idx = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--hours") && has_value) {
+            limit_hours = atof(argv[++i]);
+        } else if (!strcmp(arg, "--ambient") && has_value) {
+            plant_params.ambient = plant_params.initial = atof(argv[++i]);
+        } else if (!strcmp(arg, "--heater") && has_value) {
+            plant_params.heater_w = atof(argv[++i]);
+        } else if (!strcmp(arg, "--sensor-tau") && has_value) {
+            plant_params.sensor_tau = atof(argv[++i]);
+        } else if (!strcmp(arg, "--dead-time") && has_value) {
+            plant_params.dead_time = atof(argv[++i]);
+        } else if (!strcmp(arg, "--moisture") && has_value) {
+            plant_params.moisture_g = atof(argv[++i]);
+        } else if (!strcmp(arg, "--record") && has_value) {
+            FILE *const trace = fopen(argv[++i], "w");
+            if (trace == NULL) {
+                perror(argv[i]);
+                return 2;
+            }
+            host_set_serial_output(trace);
+        } else if (!strcmp(arg, "--replay") && has_value) {
+            replay_path = argv[++i];
+        } else if (!strcmp(arg, "--postmortem") && has_value) {
+            return run_postmortem(argv[++i]);
+        } else if (!strcmp(arg, "--tolerance") && has_value) {
+            replay_tolerance_ms = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(arg, "--heater-probe")) {
+            heater_probe = true;
+        } else if (!strcmp(arg, "--ambient-probe")) {
+            ambient_probe = true;
+        } else if (!strcmp(arg, "--humidity-sensor")) {
+            humidity_probe = true;
+        } else if (!strcmp(arg, "--ambient-change") && i + 2 < argc) {
+            ambient_change = atof(argv[++i]);
+            ambient_change_min = atof(argv[++i]);
+        } else if (!strcmp(arg, "--verbose")) {
+            verbose = true;
+        } else if (!strcmp(arg, "--lcd")) {
+            show_lcd = true;
+        } else if (!strcmp(arg, "--bus-check")) {
+            return run_bus_check();
+        } else if (!strcmp(arg, "--fault-check")) {
+            return run_fault_check();
+        } else if (!strcmp(arg, "--regression")) {
+            return run_regression();
+        } else if (!strcmp(arg, "--crc-bench")) {
+            return run_crc_bench();
+        } else if (!strcmp(arg, "--encoder-fuzz")) {
+            encoder_fuzz = true;
+        } else if (!strcmp(arg, "--humidity-check")) {
+            return run_humidity_check();
+        } else if (!strcmp(arg, "--observer")) {
+            return run_observer();
+        } else if (!strcmp(arg, "--seed") && has_value) {
+            seed = strtoul(argv[++i], NULL, 10);
+        } else {
+            usage(argv[0]);
+            return !strcmp(arg, "--help") ? 0 : 2;
+        }
+    }
+
+    if (replay_path != NULL)
+        return run_replay(replay_path, replay_tolerance_ms);
+    if (encoder_fuzz)
+        return run_encoder_fuzz(seed);
+
+    // Датчик на нагревателе имеет смысл только вместе со звеном
+    // нагревателя в модели.
+    if (heater_probe && plant_params.heater_capacity <= 0)
+        plant_params.heater_capacity = HEATER_PROBE_CAPACITY;
+
+    Testbed testbed(plant_params);
+    Ds18b20 surface_model(0x0000DEADBEEF02ULL);
+    Ds18b20 room_model(0x0000DEADBEEF03ULL);
+    Sht3x humidity_model;
+    bed = &testbed;
+    plant = &testbed.plant;
+    lcd = &testbed.lcd;
+    bus = &testbed.bus;
+    if (heater_probe) {
+        surface_probe = &surface_model;
+        surface_probe->set_user_data(HEATER_PROBE_MARK);
+        surface_probe->temperature = plant->heater();
+        bus->attach(surface_probe);
+    }
+    if (ambient_probe) {
+        room_probe = &room_model;
+        room_probe->set_user_data(AMBIENT_PROBE_MARK);
+        room_probe->temperature = plant->ambient();
+        bus->attach(room_probe);
+    }
+
+    bed->attach(on_tick);
+    if (humidity_probe) {
+        hygrometer = &humidity_model;
+        hygrometer->temperature = plant->chamber();
+        hygrometer->humidity = plant->humidity();
+        host_attach_i2c_device(HUMIDITY_ADDRESS, hygrometer);
+    }
+
+    schedule_filament_choice(filament_idx);
+
+    run_firmware();
+
+    report();
+    return panic_reason != NULL;
+}
@@ -0,0 +1,196 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <ArduinoHost.h>
+
+#include "thermostat.h"
+#include "scenarios.h"
+#include "testbed.h"
+#include "user_input.h"
+
+// Шумы модели наблюдателя (среднеквадратичные, за период): случайные
+// изменения температуры камеры, датчика и дрейфа, которых модель не
+// объясняет, и шум отфильтрованного показания датчика, °C.
+#define NOISE_CHAMBER (0.06)
+#define NOISE_SENSOR (0.001)
+#define NOISE_DRIFT (0.0003)
+#define NOISE_MEASUREMENT (0.03)
+// Сколько итераций уравнения Риккати заведомо хватает для сходимости.
+#define RICCATI_STEPS (100000)
+
+// Сколько наблюдать после перехода к сушке, мс.
+#define HOLD_MS (3600000UL)
+
+typedef double Matrix[3][3];
+
+static void multiply(const Matrix a, const Matrix b, Matrix result)
+{
+    Matrix product;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            product[i][j] = 0;
+            for (int k = 0; k < 3; k++)
+                product[i][j] += a[i][k] * b[k][j];
+        }
+    }
+    memcpy(result, product, sizeof(product));
+}
+
+static void transpose(const Matrix a, Matrix result)
+{
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            result[i][j] = a[j][i];
+}
+
+// Установившийся фильтр Калмана для модели из update_observer():
+// состояние (камера, датчик, дрейф), измеряется датчик. Итерирует
+// прогноз и коррекцию до сходимости; gain - коэффициенты коррекции,
+// predicted и updated - ковариации до и после коррекции.
+static void steady_state_kalman(double gain[3], Matrix predicted, Matrix updated)
+{
+    const double lag = (double) OBSERVER_LAG / (1L << OBSERVER_GAIN_SHIFT);
+    const Matrix model = {
+        { 1, 0, 1 },
+        { lag, 1 - lag, 0 },
+        { 0, 0, 1 },
+    };
+    const double noise[3] = { NOISE_CHAMBER, NOISE_SENSOR, NOISE_DRIFT };
+    Matrix model_t;
+    transpose(model, model_t);
+
+    Matrix p = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+    for (int step = 0; step < RICCATI_STEPS; step++) {
+        multiply(model, p, predicted);
+        multiply(predicted, model_t, predicted);
+        for (int i = 0; i < 3; i++)
+            predicted[i][i] += noise[i] * noise[i];
+
+        const double innovation = predicted[1][1] + NOISE_MEASUREMENT * NOISE_MEASUREMENT;
+        for (int i = 0; i < 3; i++)
+            gain[i] = predicted[i][1] / innovation;
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                p[i][j] = predicted[i][j] - gain[i] * predicted[1][j];
+    }
+    memcpy(updated, p, sizeof(p));
+}
+
+static void print_covariance(const char *title, const Matrix p)
+{
+    static const char *const names[3] = { "chamber", "sensor", "drift" };
+    printf("%s (*C^2, drift in *C/period):\n", title);
+    for (int i = 0; i < 3; i++)
+        printf("        %-8s %12.4e %12.4e %12.4e   sd %.4f\n", names[i], p[i][0], p[i][1], p[i][2], sqrt(p[i][i]));
+}
+
+// Состояние прогона одного профиля (в дочернем процессе).
+static Testbed *bed = NULL;
+static unsigned long preheat_ms = 0;
+static unsigned long working_ms = 0;
+static double max_chamber = -1000;
+
+// Ошибка оценки камеры: сумма квадратов, число отсчётов и наибольшая
+// по модулю, отдельно для прогрева и сушки.
+struct EstimateError
+{
+    double squares;
+    unsigned long count;
+    double worst;
+};
+
+static EstimateError errors[2];
+
+static void on_tick(void)
+{
+    const unsigned long now = millis();
+
+    apply_inputs(now);
+
+    if (bed->step(now, host_pin_output(HEATER_PIN) == HIGH)) {
+        if (heating_stage != Idle && filament != NULL) {
+            const double estimate = (double) observer_chamber / OBSERVER_ONE;
+            const double error = estimate - bed->plant.chamber();
+            EstimateError &stat = errors[heating_stage == Working ? 1 : 0];
+            stat.squares += error * error;
+            stat.count++;
+            if (fabs(error) > fabs(stat.worst))
+                stat.worst = error;
+        }
+        if (heating_stage == Working && bed->plant.chamber() > max_chamber)
+            max_chamber = bed->plant.chamber();
+    }
+
+    if (heating_stage == PreHeating && preheat_ms == 0)
+        preheat_ms = now;
+    if (heating_stage == Working && working_ms == 0)
+        working_ms = now;
+
+    if (panic_reason != NULL)
+        throw SimulationDone();
+    if (working_ms && now - working_ms >= HOLD_MS)
+        throw SimulationDone();
+    if (preheat_ms && working_ms == 0 && now - preheat_ms > PREHEAT_LIMIT_MS)
+        throw SimulationDone();
+}
+
+static double rms(const EstimateError &stat)
+{
+    return stat.count ? sqrt(stat.squares / stat.count) : 0.0;
+}
+
+static int run_profile(const void *arg)
+{
+    const int idx = *(const int *) arg;
+    const Filament &expected = filaments[idx];
+
+    Testbed testbed;
+    bed = &testbed;
+    bed->attach(on_tick);
+    schedule_filament_choice(idx);
+
+    run_firmware();
+
+    const bool ok = panic_reason == NULL && working_ms != 0;
+    printf("%s %-6s %3d *C  preheat %5.1f min, overshoot %+5.2f *C, estimate error rms/worst: "
+           "preheat %.2f/%+.2f, hold %.2f/%+.2f *C\n",
+        ok ? "  ok  " : "  FAIL", expected.name, expected.temp, (working_ms - preheat_ms) / 60000.0,
+        max_chamber - expected.temp, rms(errors[0]), errors[0].worst, rms(errors[1]), errors[1].worst);
+    return ok ? 0 : 1;
+}
+
+int run_observer(void)
+{
+    double gain[3];
+    Matrix predicted, updated;
+    steady_state_kalman(gain, predicted, updated);
+
+    printf("model: period %d ms, sensor lag %ld/%ld, heater %ld per period, dead time %d periods\n",
+        OBSERVER_PERIOD_MS, (long) OBSERVER_LAG, 1L << OBSERVER_GAIN_SHIFT, (long) OBSERVER_HEAT,
+        OBSERVER_DEAD_PERIODS);
+    printf("noise: chamber %.4f, sensor %.4f, drift %.4f, measurement %.4f *C\n", NOISE_CHAMBER, NOISE_SENSOR,
+        NOISE_DRIFT, NOISE_MEASUREMENT);
+    print_covariance("predicted covariance", predicted);
+    print_covariance("updated covariance", updated);
+
+    // Коэффициенты в единицах прошивки и те, с которыми она собрана.
+    static const char *const names[3] = { "CHAMBER", "SENSOR", "DRIFT" };
+    const long built[3] = { OBSERVER_GAIN_CHAMBER, OBSERVER_GAIN_SENSOR, OBSERVER_GAIN_DRIFT };
+    int failures = 0;
+    printf("steady-state gains:\n");
+    for (int i = 0; i < 3; i++) {
+        const long fixed = lround(gain[i] * (1L << OBSERVER_GAIN_SHIFT));
+        const bool same = fixed == built[i];
+        printf("%s #define OBSERVER_GAIN_%-8s (%ld)  // %.5f, built with %ld\n", same ? "  ok  " : "  FAIL", names[i],
+            fixed, gain[i], built[i]);
+        if (!same)
+            failures++;
+    }
+
+    printf("\nclosed loop, first %lu min of drying:\n", HOLD_MS / 60000);
+    int codes[MAX_PARALLEL_RUNS];
+    const size_t count = run_each_filament(run_profile, codes);
+    return report_failures(failures + count_failures(codes, count));
+}
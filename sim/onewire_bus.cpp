@@ -0,0 +1,63 @@
+#include <string.h>
+
+#include "onewire_bus.h"
+
+// Окно, в котором устройства выдают импульс присутствия после сброса, мкс.
+#define PRESENCE_WINDOW_US (240)
+
+OneWireBus::OneWireBus()
+    : count(0)
+    , fall_us(0)
+    , presence_window(false)
+{
+    reset_stats();
+}
+
+bool OneWireBus::attach(HostPinDevice *device)
+{
+    if (count >= MAX_DEVICES)
+        return false;
+    devices[count++] = device;
+    return true;
+}
+
+void OneWireBus::reset_stats(void)
+{
+    memset(&counters, 0, sizeof(counters));
+}
+
+void OneWireBus::master_changed(bool low, uint64_t now_us)
+{
+    if (low) {
+        fall_us = now_us;
+    } else {
+        const uint64_t duration = now_us - fall_us;
+        counters.busy_us += duration;
+        if (duration >= ONEWIRE_RESET_MIN_US) {
+            counters.resets++;
+            presence_window = true;
+        } else if (duration <= ONEWIRE_READ_SLOT_MAX_US) {
+            counters.read_slots++;
+        } else {
+            counters.write_slots++;
+        }
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+        devices[i]->master_changed(low, now_us);
+}
+
+bool OneWireBus::pulls_low(uint64_t now_us)
+{
+    bool low = false;
+    for (uint8_t i = 0; i < count; i++)
+        low |= devices[i]->pulls_low(now_us);
+
+    // Первый опрос линии после сброса - проверка присутствия.
+    if (presence_window && now_us - fall_us >= ONEWIRE_RESET_MIN_US) {
+        presence_window = false;
+        if (low && now_us - fall_us < ONEWIRE_RESET_MIN_US + PRESENCE_WINDOW_US)
+            counters.presences++;
+    }
+    return low;
+}
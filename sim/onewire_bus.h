@@ -0,0 +1,49 @@
+// Шина 1-wire с несколькими устройствами ("монтажное И": линию к земле
+// может притянуть любое устройство) и счётчиками использованных слотов,
+// по которым сравнивается стоимость вариантов работы с датчиками.
+#ifndef SIM_ONEWIRE_BUS_H
+#define SIM_ONEWIRE_BUS_H
+
+#include <stdint.h>
+
+#include <ArduinoHost.h>
+
+// Мастер держит линию в слоте чтения 1-5 мкс, в слоте записи единицы -
+// до 15 мкс, нуля - 60-120 мкс, в импульсе сброса - от 480 мкс.
+#define ONEWIRE_READ_SLOT_MAX_US (5)
+#define ONEWIRE_RESET_MIN_US (480)
+
+struct OneWireStats
+{
+    unsigned long resets; // Импульсы сброса.
+    unsigned long presences; // Сбросы, на которые ответили устройства.
+    unsigned long read_slots; // Слоты чтения.
+    unsigned long write_slots; // Слоты записи.
+    uint64_t busy_us; // Суммарное время, пока мастер держал линию.
+};
+
+class OneWireBus : public HostPinDevice
+{
+public:
+    OneWireBus();
+
+    // Подключение устройства к шине. Не более MAX_DEVICES.
+    bool attach(HostPinDevice *device);
+
+    const OneWireStats &stats(void) const { return counters; }
+    void reset_stats(void);
+
+    void master_changed(bool low, uint64_t now_us);
+    bool pulls_low(uint64_t now_us);
+
+private:
+    static const uint8_t MAX_DEVICES = 8;
+
+    HostPinDevice *devices[MAX_DEVICES];
+    uint8_t count;
+    OneWireStats counters;
+    uint64_t fall_us;
+    bool presence_window;
+};
+
+#endif // SIM_ONEWIRE_BUS_H
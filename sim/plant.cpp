@@ -0,0 +1,85 @@
+#include <math.h>
+
+#include "plant.h"
+
+// Удельная теплота парообразования воды, Дж/г.
+#define LATENT_HEAT (2260.0)
+
+double saturation_density(double celsius)
+{
+    // Давление насыщенного пара по формуле Магнуса, гПа, и плотность
+    // пара как идеального газа.
+    const double pressure = 6.112 * exp(17.62 * celsius / (243.12 + celsius));
+    return 216.7 * pressure / (celsius + 273.15);
+}
+
+Plant::Plant(const PlantParams &params)
+    : params(params)
+    , chamber_temp(params.initial)
+    , sensor_temp(params.initial)
+    , heater_temp(params.initial)
+    , moisture_g(params.moisture_g)
+    , vapor_g(params.ambient_rh / 100.0 * saturation_density(params.ambient) * params.volume_l / 1000.0)
+    , delay_pos(0)
+    , delay_acc(0)
+{
+    delay_len = (int) lround(params.dead_time / DELAY_STEP);
+    if (delay_len < 1)
+        delay_len = 1;
+    if (delay_len > DELAY_SLOTS)
+        delay_len = DELAY_SLOTS;
+    for (int i = 0; i < DELAY_SLOTS; i++)
+        delay_line[i] = false;
+}
+
+void Plant::step(double dt, bool heater_on)
+{
+    // Транспортная задержка: в камеру приходит мощность, включённая
+    // dead_time секунд назад.
+    bool delayed = delay_line[delay_pos];
+    delay_acc += dt;
+    while (delay_acc >= DELAY_STEP) {
+        delay_acc -= DELAY_STEP;
+        delayed = delay_line[delay_pos];
+        delay_line[delay_pos] = heater_on;
+        delay_pos = (delay_pos + 1) % delay_len;
+    }
+
+    // Скорость сушки удваивается на каждые 10 °C выше 50 °C.
+    double evaporated = 0;
+    if (moisture_g > 0) {
+        const double tau = params.dry_tau * pow(2.0, -(chamber_temp - 50.0) / 10.0);
+        evaporated = moisture_g * (1.0 - exp(-dt / tau));
+        moisture_g -= evaporated;
+    }
+
+    // Без звена нагревателя его мощность сразу уходит в воздух, а
+    // поверхность горячее воздуха на столько, сколько нужно, чтобы её
+    // отдать.
+    double heating = delayed ? params.heater_w : 0.0;
+    if (params.heater_capacity > 0) {
+        const double flow = params.heater_conductance * (heater_temp - chamber_temp);
+        heater_temp += (heating - flow) * dt / params.heater_capacity;
+        heating = flow;
+    } else {
+        heater_temp = chamber_temp + heating / params.heater_conductance;
+    }
+
+    // Пар уходит из камеры с обменом воздуха, на его место приходит
+    // воздух помещения со своей абсолютной влажностью.
+    const double volume_m3 = params.volume_l / 1000.0;
+    const double room_vapor = params.ambient_rh / 100.0 * saturation_density(params.ambient) * volume_m3;
+    vapor_g += evaporated + (room_vapor - vapor_g) * (1.0 - exp(-dt / params.exchange_tau));
+
+    const double power = heating - params.loss_w_per_k * (chamber_temp - params.ambient)
+        - evaporated * LATENT_HEAT / dt;
+    chamber_temp += power * dt / params.heat_capacity;
+
+    sensor_temp += (chamber_temp - sensor_temp) * (1.0 - exp(-dt / params.sensor_tau));
+}
+
+double Plant::humidity(void) const
+{
+    const double rh = 100.0 * vapor_g / (params.volume_l / 1000.0) / saturation_density(chamber_temp);
+    return rh > 100.0 ? 100.0 : rh;
+}
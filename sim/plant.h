@@ -0,0 +1,74 @@
+// Тепловая модель сушильного бокса для замкнутого контура с прошивкой.
+// Камера - сосредоточенная теплоёмкость с нагревателем и потерями в
+// окружающую среду; датчик - звено первого порядка с транспортной
+// задержкой; пластик отдаёт влагу, забирая теплоту испарения, в воздух
+// камеры, который обменивается с воздухом помещения. Если
+// задана теплоёмкость нагревателя, он - отдельное звено, отдающее тепло
+// воздуху через теплопроводность оребрения.
+#ifndef SIM_PLANT_H
+#define SIM_PLANT_H
+
+// Параметры модели. Значения по умолчанию подобраны под бокс на
+// одну катушку с нагревателем около 100 Вт.
+struct PlantParams
+{
+    double heater_w = 100.0; // Мощность нагревателя, Вт.
+    double heat_capacity = 2000.0; // Теплоёмкость камеры с катушкой, Дж/К.
+    double loss_w_per_k = 1.2; // Теплопотери через стенки, Вт/К.
+    double ambient = 22.0; // Температура в помещении, °C.
+    double initial = 22.0; // Начальная температура камеры, °C.
+    double sensor_tau = 30.0; // Постоянная времени датчика в корпусе, с.
+    double dead_time = 5.0; // Транспортная задержка нагреватель-воздух, с.
+    double moisture_g = 0.0; // Начальное количество влаги в пластике, г.
+    double dry_tau = 4.0 * 3600; // Постоянная времени сушки при 50 °C, с.
+    double heater_capacity = 0.0; // Теплоёмкость нагревателя, Дж/К (0 - звена нет).
+    double heater_conductance = 4.0; // Теплоотдача нагревателя в воздух, Вт/К.
+    double volume_l = 30.0; // Объём воздуха в камере, л.
+    double exchange_tau = 600.0; // Постоянная времени обмена воздуха с помещением, с.
+    double ambient_rh = 50.0; // Относительная влажность в помещении, %.
+};
+
+// Плотность насыщенного водяного пара, г/м3, при температуре celsius.
+double saturation_density(double celsius);
+
+class Plant
+{
+public:
+    explicit Plant(const PlantParams &params);
+
+    // Шаг интегрирования на dt секунд с заданным состоянием нагревателя.
+    void step(double dt, bool heater_on);
+
+    double chamber(void) const { return chamber_temp; }
+    double sensor(void) const { return sensor_temp; }
+    // Температура поверхности нагревателя.
+    double heater(void) const { return heater_temp; }
+    double moisture(void) const { return moisture_g; }
+    // Относительная влажность воздуха камеры, %.
+    double humidity(void) const;
+    // Изменение температуры в помещении во время прогона.
+    void set_ambient(double celsius) { params.ambient = celsius; }
+    double ambient(void) const { return params.ambient; }
+    const PlantParams &parameters(void) const { return params; }
+
+private:
+    // Шаг буфера транспортной задержки, с.
+    static constexpr double DELAY_STEP = 0.1;
+    static constexpr int DELAY_SLOTS = 600;
+
+    PlantParams params;
+    double chamber_temp;
+    double sensor_temp;
+    double heater_temp;
+    double moisture_g;
+    // Водяной пар в воздухе камеры, г.
+    double vapor_g;
+
+    // Кольцевой буфер прошлых состояний нагревателя.
+    bool delay_line[DELAY_SLOTS];
+    int delay_pos;
+    int delay_len;
+    double delay_acc;
+};
+
+#endif // SIM_PLANT_H
@@ -0,0 +1,150 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <OneWire.h>
+
+#include "thermostat.h"
+#include "scenarios.h"
+
+// Сколько байтов кольца выводит прошивка: поля до crc включительно.
+#define POSTMORTEM_BYTES (offsetof(PostMortem, crc) + 1)
+
+// Разбор полагается на то, что у хоста и AVR одинаковое размещение полей.
+static_assert(offsetof(PostMortem, events) == 4, "PostMortem header is 4 bytes");
+static_assert(offsetof(PostMortem, crc) == 4 + 4 * POSTMORTEM_EVENTS, "PostMortemEvent is 4 bytes");
+
+static const char *const stage_names[] = { "Idle", "PreHeating", "Working" };
+static const char *const action_names[] = { "none", "next", "prev", "confirm", "long press", "double click",
+    "shift next", "shift prev" };
+static const char *const sensor_errors[] = { "chamber probe did not answer", "reading rejected by the filter",
+    "auxiliary probe lost", "humidity sensor lost" };
+
+static const char *name_of(const char *const *names, size_t count, uint8_t value)
+{
+    return value < count ? names[value] : "?";
+}
+
+static void print_reset_cause(uint8_t cause)
+{
+    static const char *const bits[] = { "power-on", "external", "brown-out", "watchdog" };
+    printf("0x%02X", cause);
+    for (uint8_t bit = 0; bit < 4; bit++)
+        if (cause & (1 << bit))
+            printf(" %s", bits[bit]);
+}
+
+static void print_event(const PostMortemEvent &event)
+{
+    switch (event.kind) {
+        case EventBoot:
+            printf("boot, reset cause ");
+            print_reset_cause(event.data);
+            break;
+        case EventStage:
+            printf("stage %s", name_of(stage_names, 3, event.data));
+            break;
+        case EventHeater:
+            printf("heater %s", event.data ? "on" : "off");
+            break;
+        case EventSensorError:
+            printf("sensor error: %s", name_of(sensor_errors, 4, event.data));
+            break;
+        case EventInput:
+            printf("input %s", name_of(action_names, 8, event.data));
+            break;
+        case EventOverrun:
+            printf("sensor read %s%u ms late", event.data == 255 ? ">= " : "", event.data);
+            break;
+        case EventPanic:
+            printf("panic %s", name_of(panic_messages, PanicNoHeat + 1, event.data));
+            break;
+        default:
+            printf("unknown event %u, data %u", event.kind, event.data);
+            break;
+    }
+    printf("\n");
+}
+
+// Печать кольца от самого старого события к панике/сбросу. Время -
+// относительно последнего события.
+static void print_postmortem(const PostMortem &record)
+{
+    if (record.reason == NoPanic)
+        printf("saved after a reset");
+    else
+        printf("saved on panic \"%s\"", name_of(panic_messages, PanicNoHeat + 1, record.reason));
+    printf(", run started by reset cause ");
+    print_reset_cause(record.reset_cause);
+    printf("\n");
+
+    const PostMortemEvent &last = record.events[(record.head + POSTMORTEM_EVENTS - 1) % POSTMORTEM_EVENTS];
+    for (uint8_t i = 0; i < POSTMORTEM_EVENTS; i++) {
+        const PostMortemEvent &event = record.events[(record.head + i) % POSTMORTEM_EVENTS];
+        if (event.kind == EventNone)
+            continue;
+        const uint16_t ago = last.time - event.time;
+        printf("  %9.3f s  ", 0.0 - ago * (1 << POSTMORTEM_TICK_SHIFT) / 1000.0);
+        print_event(event);
+    }
+}
+
+static bool parse_hex(const char *text, uint8_t *bytes, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        char digits[3] = { text[2 * i], text[2 * i + 1], 0 };
+        char *end = NULL;
+        if (!digits[0] || !digits[1])
+            return false;
+        bytes[i] = (uint8_t) strtoul(digits, &end, 16);
+        if (*end != 0)
+            return false;
+    }
+    return true;
+}
+
+int run_postmortem(const char *path)
+{
+    FILE *const file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return 2;
+    }
+
+    static const char prefix[] = "# postmortem ";
+    char line[512];
+    unsigned long line_no = 0;
+    int found = 0;
+    int failures = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_no++;
+        const char *const start = strstr(line, prefix);
+        if (start == NULL)
+            continue;
+
+        PostMortem record;
+        memset(&record, 0, sizeof(record));
+        found++;
+        if (!parse_hex(start + strlen(prefix), (uint8_t *) &record, POSTMORTEM_BYTES)) {
+            printf("%s:%lu: malformed post-mortem line\n", path, line_no);
+            failures++;
+            continue;
+        }
+        if (record.version != POSTMORTEM_VERSION
+            || OneWire::crc8((const uint8_t *) &record, offsetof(PostMortem, crc)) != record.crc) {
+            printf("%s:%lu: post-mortem version or CRC mismatch\n", path, line_no);
+            failures++;
+            continue;
+        }
+        printf("%s:%lu: ", path, line_no);
+        print_postmortem(record);
+    }
+    fclose(file);
+
+    if (found == 0)
+        printf("%s: no \"%s\" lines\n", path, prefix);
+    return found == 0 || failures ? 1 : 0;
+}
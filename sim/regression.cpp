@@ -0,0 +1,175 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <ArduinoHost.h>
+
+#include "thermostat.h"
+#include "scenarios.h"
+#include "testbed.h"
+#include "user_input.h"
+
+// Как часто сверять обратный отсчёт с виртуальными часами, мс.
+#define ETA_CHECK_MS (60000)
+// Допустимое расхождение счётчика секунд с часами, с.
+#define ETA_TOLERANCE_S (1)
+// Через сколько после сигнала окончания пользователь нажимает кнопку, мс.
+#define ACK_DELAY_MS (10000)
+// Сколько наблюдать после нажатия, мс.
+#define AFTER_ACK_MS (5000)
+
+// Состояние прогона одного профиля (в дочернем процессе).
+static int filament_idx = 0;
+static Testbed *bed = NULL;
+
+static int last_stage = -1;
+static unsigned long preheat_ms = 0;
+static unsigned long working_ms = 0;
+static unsigned long finish_ms = 0;
+static unsigned long ack_ms = 0;
+static unsigned long next_eta_check = 0;
+static long worst_eta_error = 0;
+static bool heater_after_finish = false;
+
+// Проверяет, что на экране показан обратный отсчёт, отличающийся от
+// ожидаемого не больше чем на ETA_TOLERANCE_S + 1 с (экран обновляется
+// раз в секунду).
+static void check_eta_on_screen(unsigned long now, long remaining)
+{
+    const char *const text = bed->lcd.line(1);
+    unsigned hours = 0, minutes = 0, secs = 0;
+    if (sscanf(text, "ETA %u:%u:%u", &hours, &minutes, &secs) != 3)
+        fail_run(now, "no ETA on the second line");
+    const long shown = hours * 3600L + minutes * 60L + secs;
+    if (labs(shown - remaining) > ETA_TOLERANCE_S + 1)
+        fail_run(now, "ETA on the screen is wrong");
+}
+
+static void check_screen(unsigned long now, uint8_t row, const char *prefix)
+{
+    if (strncmp(bed->lcd.line(row), prefix, strlen(prefix)) != 0) {
+        char what[80];
+        snprintf(what, sizeof(what), "line %u shows \"%s\" instead of \"%s...\"", row + 1, bed->lcd.line(row), prefix);
+        fail_run(now, what);
+    }
+}
+
+static void on_stage_changed(unsigned long now, int stage)
+{
+    const Filament *const expected = &filaments[filament_idx];
+
+    if (filament != expected)
+        fail_run(now, "wrong filament selected");
+    if (stage == PreHeating && last_stage == Idle) {
+        preheat_ms = now;
+    } else if (stage == Working && last_stage == PreHeating) {
+        working_ms = now;
+        next_eta_check = now + ETA_CHECK_MS;
+    } else {
+        fail_run(now, "unexpected stage transition");
+    }
+    last_stage = stage;
+}
+
+static void on_tick(void)
+{
+    const unsigned long now = millis();
+    const int heater = host_pin_output(HEATER_PIN);
+
+    apply_inputs(now);
+
+    bed->step(now, heater == HIGH);
+
+    if (panic_reason != NULL)
+        fail_run(now, panic_reason);
+
+    if (finish_ms == 0 && heating_stage != last_stage)
+        on_stage_changed(now, heating_stage);
+
+    if (last_stage == PreHeating && now - preheat_ms > PREHEAT_LIMIT_MS)
+        fail_run(now, "preheating did not finish");
+
+    // Оставшееся время на экране - time_sec - seconds; сверяем его с
+    // временем, прошедшим с начала сушки.
+    if (working_ms && finish_ms == 0 && now >= next_eta_check) {
+        next_eta_check += ETA_CHECK_MS;
+        const long elapsed = (now - working_ms) / 1000;
+        const long error = (long) seconds - elapsed;
+        if (labs(error) > labs(worst_eta_error))
+            worst_eta_error = error;
+        if (labs(error) > ETA_TOLERANCE_S)
+            fail_run(now, "countdown drifted from the clock");
+
+        const Filament &expected = filaments[filament_idx];
+        char header[32];
+        snprintf(header, sizeof(header), "%s %u / ", expected.name, expected.temp);
+        check_screen(now, 0, header);
+        check_eta_on_screen(now, (long) expected.time_sec - elapsed);
+    }
+
+    // Окончание сушки прошивка отмечает сигналом пищалки.
+    if (working_ms && finish_ms == 0 && host_pin_output(BEEPER_PIN) == HIGH) {
+        finish_ms = now;
+        ack_ms = now + ACK_DELAY_MS;
+        schedule_press(ack_ms);
+    }
+
+    if (finish_ms && heater == HIGH)
+        heater_after_finish = true;
+
+    // Перед нажатием кнопки на экране сообщение об окончании.
+    if (ack_ms && now == ack_ms - 1) {
+        check_screen(now, 0, "Finished!");
+        check_screen(now, 1, "Press any key...");
+    }
+
+    if (ack_ms && now >= ack_ms + AFTER_ACK_MS)
+        throw SimulationDone();
+    if (now > PREHEAT_LIMIT_MS + (filaments[filament_idx].time_sec + 600) * 1000UL)
+        fail_run(now, "run did not finish");
+}
+
+static int run_profile(const void *arg)
+{
+    filament_idx = *(const int *) arg;
+    const Filament &expected = filaments[filament_idx];
+
+    Testbed testbed;
+    bed = &testbed;
+    bed->attach(on_tick);
+    schedule_filament_choice(filament_idx);
+    last_stage = Idle;
+
+    run_firmware();
+
+    const unsigned long now = millis();
+    if (finish_ms == 0)
+        note_failure("no finish signal");
+
+    // Сушка должна закончиться, когда счётчик превысит time_sec.
+    const double working_s = (finish_ms - working_ms) / 1000.0;
+    if (fabs(working_s - (expected.time_sec + 1)) > ETA_TOLERANCE_S + 1)
+        note_failure("dried for %.1f s instead of %lu s", working_s, expected.time_sec);
+    if (heater_after_finish)
+        note_failure("heater switched on after finish");
+    if (host_pin_output(HEATER_PIN) != LOW)
+        note_failure("heater on at the end");
+    if (bed->lcd.stats().violations)
+        note_failure("LCD timing: %s", bed->lcd.violation(0));
+
+    printf("%s %-6s %2d *C  preheat %5.1f min, dried %2lu:%02lu:%02lu, countdown error %+ld s, %5.1f h simulated\n",
+        run_failure[0] ? "  FAIL" : "  ok  ", expected.name, expected.temp, (working_ms - preheat_ms) / 60000.0,
+        (finish_ms - working_ms) / 3600000, (finish_ms - working_ms) / 60000 % 60, (finish_ms - working_ms) / 1000 % 60,
+        worst_eta_error, now / 3600000.0);
+    if (run_failure[0])
+        printf("        %s\n", run_failure);
+    return run_failure[0] ? 1 : 0;
+}
+
+int run_regression(void)
+{
+    int codes[MAX_PARALLEL_RUNS];
+    const size_t count = run_each_filament(run_profile, codes);
+    return report_failures(count_failures(codes, count));
+}
@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <ArduinoHost.h>
+
+#include "thermostat.h"
+#include "ds18b20.h"
+#include "onewire_bus.h"
+#include "scenarios.h"
+#include "sht3x.h"
+
+// Сколько событий каждого типа можно загрузить из трассы.
+#define MAX_INPUTS (4096)
+#define MAX_SCRATCHPADS (65536)
+#define MAX_TOGGLES (16384)
+#define MAX_SEARCHES (1024)
+#define MAX_HUMIDITY (32768)
+// Сколько датчиков может быть на шине при воспроизведении.
+#define MAX_REPLAY_PROBES (3)
+// Сколько ещё работать после последнего события трассы, мс.
+#define TAIL_MS (5000)
+
+struct TraceInput
+{
+    unsigned long at_ms;
+    int value;
+};
+
+struct TraceScratchpad
+{
+    unsigned long at_ms;
+    // Датчик не нашёлся на шине ("S <ms> -").
+    bool absent;
+    uint8_t data[9];
+};
+
+// Поиск датчиков: сколько нашлось и с какого блокнота в трассе
+// начинаются прочитанные при поиске.
+struct TraceSearch
+{
+    size_t first_scratchpad;
+    uint8_t probes;
+};
+
+struct TraceHumidity
+{
+    // Датчик влажности не ответил на чтение ("R <ms> -").
+    bool absent;
+    uint8_t data[6];
+};
+
+struct TraceToggle
+{
+    unsigned long at_ms;
+    int state;
+};
+
+static TraceInput *inputs = NULL;
+static size_t input_count = 0;
+static size_t input_pos = 0;
+
+static TraceScratchpad *scratchpads = NULL;
+static size_t scratchpad_count = 0;
+static size_t scratchpad_pos = 0;
+// DallasTemperature::begin() в setup() читает блокнот каждого найденного
+// датчика мимо трассы: столько первых чтений отдаются моделями как есть.
+// Все остальные чтения прошивка пишет в трассу.
+static uint8_t untraced_reads = 0;
+// Прошивка запросила блокнот сверх записанных - трасса закончилась.
+static bool trace_exhausted = false;
+
+static TraceSearch *searches = NULL;
+static size_t search_count = 0;
+static size_t search_pos = 0;
+
+// Результаты датчика влажности отдаются по порядку. Ошибки записи
+// команды в трассу не попадают: после последней строки R датчик молчит.
+static TraceHumidity *humidity = NULL;
+static size_t humidity_count = 0;
+static size_t humidity_pos = 0;
+
+static TraceToggle *expected = NULL;
+static size_t expected_count = 0;
+static size_t expected_pos = 0;
+
+static unsigned long tolerance = 0;
+static unsigned long end_ms = 0;
+static int last_heater = LOW;
+static unsigned long matched = 0;
+static unsigned long max_skew_ms = 0;
+static bool diverged = false;
+static bool sensor_detached = false;
+// Шины с 1..MAX_REPLAY_PROBES датчиками; подключена та, что соответствует
+// последнему поиску в трассе. Блокноты всех датчиков подменяются
+// записанными по порядку, какой бы датчик ни читался.
+static OneWireBus *buses[MAX_REPLAY_PROBES];
+static uint8_t bus_probes = 1;
+
+static bool parse_hex_byte(const char *text, uint8_t *value)
+{
+    char digits[3] = { text[0], text[1], 0 };
+    char *end = NULL;
+    if (!digits[0] || !digits[1])
+        return false;
+    *value = (uint8_t) strtoul(digits, &end, 16);
+    return *end == 0;
+}
+
+static bool load_trace(const char *path)
+{
+    FILE *const file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    char line[128];
+    unsigned long line_no = 0;
+    bool ok = true;
+
+    while (ok && fgets(line, sizeof(line), file) != NULL) {
+        line_no++;
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r')
+            continue;
+
+        char kind = 0;
+        unsigned long at_ms = 0;
+        char data[64] = "";
+        if (sscanf(line, "%c %lu %63s", &kind, &at_ms, data) != 3) {
+            ok = false;
+            break;
+        }
+
+        if (kind == 'A' && input_count < MAX_INPUTS) {
+            inputs[input_count++] = { at_ms, atoi(data) };
+        } else if (kind == 'H' && expected_count < MAX_TOGGLES) {
+            expected[expected_count++] = { at_ms, atoi(data) ? HIGH : LOW };
+        } else if (kind == 'S' && scratchpad_count < MAX_SCRATCHPADS) {
+            TraceScratchpad &entry = scratchpads[scratchpad_count++];
+            entry.at_ms = at_ms;
+            entry.absent = !strcmp(data, "-");
+            for (uint8_t i = 0; !entry.absent && i < 9 && ok; i++)
+                ok = parse_hex_byte(data + 2 * i, &entry.data[i]);
+        } else if (kind == 'P' && search_count < MAX_SEARCHES) {
+            const int probes = atoi(data);
+            if (probes > MAX_REPLAY_PROBES || (size_t) probes > scratchpad_count) {
+                ok = false;
+            } else if (probes > 0) {
+                searches[search_count++] = { scratchpad_count - probes, (uint8_t) probes };
+            }
+        } else if (kind == 'R' && humidity_count < MAX_HUMIDITY) {
+            TraceHumidity &entry = humidity[humidity_count++];
+            entry.absent = !strcmp(data, "-");
+            for (uint8_t i = 0; !entry.absent && i < 6 && ok; i++)
+                ok = parse_hex_byte(data + 2 * i, &entry.data[i]);
+        } else if (kind == 'E') {
+            // Оценки наблюдателя только для настройки, не воспроизводятся.
+        } else {
+            ok = false;
+        }
+
+        if (at_ms > end_ms)
+            end_ms = at_ms;
+    }
+    fclose(file);
+
+    if (!ok)
+        fprintf(stderr, "%s:%lu: malformed or excess trace line\n", path, line_no);
+    return ok;
+}
+
+static void serve_scratchpad(uint8_t scratchpad[9], void *context)
+{
+    (void) context;
+    if (untraced_reads > 0) {
+        untraced_reads--;
+        return;
+    }
+    if (scratchpad_pos >= scratchpad_count) {
+        trace_exhausted = true;
+        return;
+    }
+    memcpy(scratchpad, scratchpads[scratchpad_pos++].data, 9);
+}
+
+static bool serve_humidity(uint8_t result[6], void *context)
+{
+    (void) context;
+    if (humidity_pos >= humidity_count)
+        return false;
+    const TraceHumidity &entry = humidity[humidity_pos++];
+    memcpy(result, entry.data, 6);
+    return !entry.absent;
+}
+
+static void report_divergence(unsigned long now, const char *what)
+{
+    if (!diverged)
+        printf("[%8lu ms] first divergence: %s\n", now, what);
+    diverged = true;
+}
+
+static void on_tick(void)
+{
+    const unsigned long now = millis();
+
+    while (input_pos < input_count && inputs[input_pos].at_ms <= now)
+        host_set_analog(USER_INPUT_PIN, inputs[input_pos++].value);
+
+    // Впереди блокноты очередного поиска: на шине столько датчиков,
+    // сколько он нашёл.
+    bool changed = false;
+    while (search_pos < search_count && searches[search_pos].first_scratchpad <= scratchpad_pos) {
+        bus_probes = searches[search_pos++].probes;
+        changed = true;
+    }
+    // Датчик пропал с шины: отключаем модель, чтобы поиск её не нашёл.
+    const bool absent = untraced_reads == 0 && scratchpad_pos < scratchpad_count && scratchpads[scratchpad_pos].absent;
+    if (absent != sensor_detached || changed) {
+        sensor_detached = absent;
+        host_attach_pin_device(SENSOR_PIN, absent ? NULL : buses[bus_probes - 1]);
+    }
+
+    const int heater = host_pin_output(HEATER_PIN);
+    if (heater != last_heater) {
+        last_heater = heater;
+        if (expected_pos >= expected_count) {
+            report_divergence(now, "unexpected heater toggle after the end of the trace");
+        } else {
+            const TraceToggle &toggle = expected[expected_pos++];
+            const unsigned long skew = now > toggle.at_ms ? now - toggle.at_ms : toggle.at_ms - now;
+            if (toggle.state != heater) {
+                report_divergence(now, "heater state differs from the trace");
+            } else if (skew > tolerance) {
+                char what[80];
+                snprintf(what, sizeof(what), "heater toggle %lu ms away from the trace", skew);
+                report_divergence(now, what);
+            } else {
+                matched++;
+            }
+            if (skew > max_skew_ms)
+                max_skew_ms = skew;
+        }
+    }
+
+    if (panic_reason != NULL)
+        throw SimulationDone();
+    if (trace_exhausted)
+        throw SimulationDone();
+    if (now > end_ms + TAIL_MS)
+        throw SimulationDone();
+}
+
+int run_replay(const char *path, unsigned long tolerance_ms)
+{
+    inputs = new TraceInput[MAX_INPUTS];
+    scratchpads = new TraceScratchpad[MAX_SCRATCHPADS];
+    searches = new TraceSearch[MAX_SEARCHES];
+    humidity = new TraceHumidity[MAX_HUMIDITY];
+    expected = new TraceToggle[MAX_TOGGLES];
+    if (!load_trace(path))
+        return 2;
+    tolerance = tolerance_ms;
+
+    Ds18b20 models[MAX_REPLAY_PROBES] = { Ds18b20(0x0000DEADBEEF01ULL), Ds18b20(0x0000DEADBEEF02ULL),
+        Ds18b20(0x0000DEADBEEF03ULL) };
+    OneWireBus bus_models[MAX_REPLAY_PROBES];
+    for (uint8_t i = 0; i < MAX_REPLAY_PROBES; i++) {
+        models[i].set_scratchpad_hook(serve_scratchpad, NULL);
+        buses[i] = &bus_models[i];
+        for (uint8_t j = 0; j <= i; j++)
+            buses[i]->attach(&models[j]);
+    }
+    // Трассы без строк P (с одним датчиком) воспроизводятся на шине с
+    // одним датчиком; с первого поиска - на шине с найденными им.
+    if (search_count > 0 && searches[0].first_scratchpad == 0)
+        bus_probes = searches[search_pos++].probes;
+
+    untraced_reads = bus_probes;
+
+    host_reset();
+    host_attach_pin_device(SENSOR_PIN, buses[bus_probes - 1]);
+    // Датчик влажности подключается, только если он был при записи:
+    // иначе самопроверка найдёт его, а трасса не даст результатов.
+    Sht3x hygrometer;
+    hygrometer.set_result_hook(serve_humidity, NULL);
+    if (humidity_count > 0)
+        host_attach_i2c_device(HUMIDITY_ADDRESS, &hygrometer);
+    host_set_tick_handler(on_tick);
+
+    try {
+        setup();
+        for (;;)
+            loop();
+    } catch (const SimulationDone &) {
+    }
+
+    // Отсутствие датчика прошивка видит сразу, до чтения блокнота.
+    if (sensor_detached && panic_reason != NULL)
+        scratchpad_pos++;
+
+    printf("\n");
+    printf("trace:         %s\n", path);
+    printf("replayed:      %lu of %lu inputs, %lu of %lu scratchpads, %.1f s\n", (unsigned long) input_pos,
+        (unsigned long) input_count, (unsigned long) scratchpad_pos, (unsigned long) scratchpad_count,
+        millis() / 1000.0);
+    if (humidity_count > 0)
+        printf("humidity:      %lu of %lu results\n", (unsigned long) humidity_pos, (unsigned long) humidity_count);
+    if (panic_reason != NULL)
+        printf("panic:         %s\n", panic_reason);
+    printf("heater:        %lu of %lu toggles matched, max skew %lu ms (tolerance %lu ms)\n", matched,
+        (unsigned long) expected_count, max_skew_ms, tolerance);
+    if (expected_pos < expected_count)
+        report_divergence(millis(), "trace has heater toggles the replay did not reproduce");
+    printf("result:        %s\n", diverged ? "DIVERGED" : "MATCHED");
+
+    delete[] inputs;
+    delete[] scratchpads;
+    delete[] searches;
+    delete[] humidity;
+    delete[] expected;
+    return diverged ? 1 : 0;
+}
@@ -0,0 +1,74 @@
+// Отдельные режимы стенда, которые вызываются из sim/main.cpp.
+// Каждый возвращает код завершения процесса: 0 - всё в порядке.
+#ifndef SIM_SCENARIOS_H
+#define SIM_SCENARIOS_H
+
+#include <stddef.h>
+
+// Исключение, которым обработчик тиков останавливает прошивку.
+struct SimulationDone
+{
+};
+
+// Запуск fn в дочернем процессе. Прошивка хранит состояние в глобальных
+// переменных, поэтому каждый прогон в сценариях начинается с чистого
+// процесса. Возвращает код завершения fn или -1, если процесс упал.
+int run_isolated(int (*fn)(const void *arg), const void *arg);
+
+// Сколько прогонов run_isolated_parallel() запускает одновременно.
+#define MAX_PARALLEL_RUNS (16)
+
+// То же для count прогонов сразу: fn получает элементы массива args
+// размером size. Вывод прогонов печатается по порядку, коды завершения
+// записываются в codes.
+void run_isolated_parallel(int (*fn)(const void *arg), const void *args, size_t size, size_t count, int *codes);
+
+// Проверка стека OneWire/DallasTemperature на модели шины с несколькими
+// датчиками: поиск, разрешение, паразитное питание, тревоги.
+int run_bus_check(void);
+
+// Внесение сбоев в шины датчика и дисплея (ошибки CRC, пропадание
+// датчика, залипшие и ложные показания, NAK дисплея) и проверка реакции
+// прошивки: причина паники, время обнаружения, выключение нагревателя.
+int run_fault_check(void);
+
+// Фаззинг декодера энкодера: случайные сигналы на входе АЦП (дребезг,
+// быстрое и медленное вращение, шум, разброс резисторов, недокрученные
+// щелчки). Печатает потерянные и лишние действия и задержку распознавания.
+int run_encoder_fuzz(unsigned long seed);
+
+// Проверка и сравнение вариантов CRC-8 (ONEWIRE_CRC8_TABLE = 0..3) и
+// CRC-16 из OneWire: полная эквивалентность функций обновления и скорость
+// на хосте. Такты на AVR и размер прошивки считает bench/run.sh.
+int run_crc_bench(void);
+
+// Полный цикл сушки каждого пластика из filaments[] под виртуальными
+// часами (параллельно, по процессу на профиль): выбор в меню, прогрев,
+// сушка, сигнал окончания, нагреватель выключен после него.
+int run_regression(void);
+
+// Окончание сушки по влажности: каждый пластик с влажной катушкой и
+// датчиком SHT3x в камере. Сушка должна закончиться на плато влажности
+// ниже dry_rh раньше времени из профиля, без нарушений таймингов
+// дисплея и чтений датчика до конца измерения; при потере датчика -
+// по времени.
+int run_humidity_check(void);
+
+// Наблюдатель температуры камеры: установившийся фильтр Калмана для
+// модели из прошивки (коэффициенты и ковариации, сверка с теми, с
+// которыми собрана прошивка) и ошибка оценки камеры в замкнутом контуре
+// для каждого пластика.
+int run_observer(void);
+
+// Воспроизведение трассы, записанной прошивкой с TRACE_RECORDER: входы
+// энкодера подаются в записанные моменты, блокноты термодатчика - в
+// записанном порядке. Переключения нагревателя сравниваются с трассой,
+// расхождение по времени больше tolerance_ms считается ошибкой.
+int run_replay(const char *path, unsigned long tolerance_ms);
+
+// Разбор кольца событий перед отказом из вывода прошивки в Serial
+// (строки "# postmortem ..." с экрана журнала отказов): события от
+// самого старого до паники или сброса.
+int run_postmortem(const char *path);
+
+#endif // SIM_SCENARIOS_H
@@ -0,0 +1,115 @@
+#include <math.h>
+#include <string.h>
+
+#include "sht3x.h"
+
+// Однократное измерение, высокая повторяемость, без растяжения такта.
+#define CMD_MEASURE_MSB (0x24)
+#define CMD_MEASURE_LSB (0x00)
+// Длительность такого измерения по документации (максимум), мкс.
+#define MEASURE_US (15500)
+
+uint8_t sht3x_crc8(const uint8_t *data, uint8_t len)
+{
+    uint8_t crc = 0xFF;
+
+    while (len--) {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++)
+            crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+    return crc;
+}
+
+Sht3x::Sht3x()
+    : temperature(25.0)
+    , humidity(50.0)
+    , nak(false)
+    , result_hook(NULL)
+    , result_context(NULL)
+    , command_len(0)
+    , measuring(false)
+    , ready_us(0)
+    , has_result(false)
+    , read_pos(0)
+{
+    memset(command, 0, sizeof(command));
+    memset(result, 0, sizeof(result));
+    memset(&counters, 0, sizeof(counters));
+}
+
+bool Sht3x::start(bool read)
+{
+    if (nak)
+        return false;
+    if (!read) {
+        command_len = 0;
+        return true;
+    }
+    if (measuring && host_time_us() < ready_us) {
+        counters.early_reads++;
+        return false;
+    }
+    if (measuring) {
+        measuring = false;
+        latch();
+    }
+    if (!has_result)
+        return false;
+    read_pos = 0;
+    return true;
+}
+
+bool Sht3x::write(uint8_t value)
+{
+    if (command_len < sizeof(command))
+        command[command_len++] = value;
+    if (command_len == sizeof(command)) {
+        if (command[0] == CMD_MEASURE_MSB && command[1] == CMD_MEASURE_LSB) {
+            measuring = true;
+            has_result = false;
+            ready_us = host_time_us() + MEASURE_US;
+            counters.measurements++;
+        } else {
+            counters.bad_commands++;
+        }
+    }
+    return true;
+}
+
+uint8_t Sht3x::read(void)
+{
+    return read_pos < sizeof(result) ? result[read_pos++] : 0xFF;
+}
+
+void Sht3x::stop(void)
+{
+    // Результат читается один раз: после чтения датчик ждёт новой команды.
+    if (read_pos > 0) {
+        has_result = false;
+        read_pos = 0;
+        counters.results++;
+    }
+}
+
+// Результат по формулам документации: T = -45 + 175 * S / 65535,
+// RH = 100 * S / 65535.
+void Sht3x::latch(void)
+{
+    double t = (temperature + 45.0) / 175.0 * 65535.0;
+    double rh = humidity / 100.0 * 65535.0;
+    t = t < 0 ? 0 : t > 65535 ? 65535 : t;
+    rh = rh < 0 ? 0 : rh > 65535 ? 65535 : rh;
+    const uint16_t raw_t = (uint16_t) lround(t);
+    const uint16_t raw_rh = (uint16_t) lround(rh);
+
+    result[0] = raw_t >> 8;
+    result[1] = raw_t & 0xFF;
+    result[2] = sht3x_crc8(result, 2);
+    result[3] = raw_rh >> 8;
+    result[4] = raw_rh & 0xFF;
+    result[5] = sht3x_crc8(result + 3, 2);
+    has_result = true;
+    if (result_hook != NULL && !result_hook(result, result_context))
+        has_result = false;
+}
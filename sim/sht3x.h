@@ -0,0 +1,69 @@
+// Модель датчика влажности и температуры SHT3x на шине I2C.
+// Подключается через host_attach_i2c_device() по адресу HUMIDITY_ADDRESS
+// и отвечает на однократное измерение с высокой повторяемостью без
+// растяжения такта (0x2400): пока измерение идёт, чтение с адреса
+// датчика получает NAK, как у настоящего датчика. Слова результата
+// защищены CRC-8 (полином 0x31, начальное значение 0xFF).
+#ifndef SIM_SHT3X_H
+#define SIM_SHT3X_H
+
+#include <stdint.h>
+
+#include <ArduinoHost.h>
+
+// CRC-8 слова данных SHT3x.
+uint8_t sht3x_crc8(const uint8_t *data, uint8_t len);
+
+struct Sht3xStats
+{
+    unsigned long measurements; // Начатых измерений.
+    unsigned long results; // Прочитанных результатов.
+    unsigned long early_reads; // Чтений до окончания измерения (NAK).
+    unsigned long bad_commands; // Неизвестных команд.
+};
+
+class Sht3x : public HostI2cDevice
+{
+public:
+    Sht3x();
+
+    // Температура и относительная влажность, которые покажет следующее
+    // измерение. Задаются моделью сушилки.
+    double temperature;
+    double humidity;
+    // Отвечать NAK на адрес (датчик отключён).
+    bool nak;
+
+    // Подмена 6 байтов результата (воспроизведение трассы). Обработчик
+    // получает вычисленный результат и может переписать его или вернуть
+    // false, чтобы датчик ответил NAK.
+    typedef bool (*ResultHook)(uint8_t result[6], void *context);
+    void set_result_hook(ResultHook hook, void *context)
+    {
+        result_hook = hook;
+        result_context = context;
+    }
+
+    bool start(bool read);
+    bool write(uint8_t value);
+    uint8_t read(void);
+    void stop(void);
+
+    const Sht3xStats &stats(void) const { return counters; }
+
+private:
+    void latch(void);
+
+    ResultHook result_hook;
+    void *result_context;
+    uint8_t command[2];
+    uint8_t command_len;
+    bool measuring;
+    uint64_t ready_us;
+    bool has_result;
+    uint8_t result[6];
+    uint8_t read_pos;
+    Sht3xStats counters;
+};
+
+#endif // SIM_SHT3X_H
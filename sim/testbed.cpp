@@ -0,0 +1,90 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <Arduino.h>
+#include <ArduinoHost.h>
+
+#include "scenarios.h"
+#include "testbed.h"
+#include "user_input.h"
+
+char run_failure[160];
+
+Testbed::Testbed(const PlantParams &params)
+    : plant(params)
+    , probe(CHAMBER_PROBE_SERIAL)
+{
+    probe.temperature = plant.sensor();
+    bus.attach(&probe);
+}
+
+void Testbed::attach(void (*on_tick)(void))
+{
+    host_reset();
+    host_attach_pin_device(SENSOR_PIN, &bus);
+    host_attach_i2c_device(LCD_ADDRESS, &lcd);
+    host_set_tick_handler(on_tick);
+    clear_inputs();
+}
+
+bool Testbed::step(unsigned long now, bool heater_on)
+{
+    if (now % PLANT_STEP_MS != 0)
+        return false;
+    plant.step(PLANT_STEP_MS / 1000.0, heater_on);
+    probe.temperature = plant.sensor();
+    return true;
+}
+
+void run_firmware(void)
+{
+    try {
+        setup();
+        for (;;)
+            loop();
+    } catch (const SimulationDone &) {
+    }
+}
+
+void note_failure(const char *format, ...)
+{
+    if (run_failure[0] != 0)
+        return;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(run_failure, sizeof(run_failure), format, args);
+    va_end(args);
+}
+
+void fail_run(unsigned long now, const char *what)
+{
+    note_failure("at %lu s: %s", now / 1000, what);
+    throw SimulationDone();
+}
+
+size_t run_each_filament(int (*fn)(const void *arg), int *codes)
+{
+    int indexes[MAX_PARALLEL_RUNS];
+    size_t count = 0;
+    while (count < MAX_PARALLEL_RUNS && count < filaments_count) {
+        indexes[count] = count;
+        count++;
+    }
+    run_isolated_parallel(fn, indexes, sizeof(indexes[0]), count, codes);
+    return count;
+}
+
+int count_failures(const int *codes, size_t count)
+{
+    int failures = 0;
+    for (size_t i = 0; i < count; i++)
+        if (codes[i] != 0)
+            failures++;
+    return failures;
+}
+
+int report_failures(int failures)
+{
+    printf("%s: %d failure(s)\n", failures ? "FAILED" : "PASSED", failures);
+    return failures ? 1 : 0;
+}
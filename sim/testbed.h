@@ -0,0 +1,62 @@
+// Общий стенд сценариев: модель сушилки, термодатчик камеры на шине
+// 1-wire и дисплей, подключённые к прослойке, прогон прошивки под
+// виртуальными часами и итог по прогонам. Сценарии добавляют к нему
+// свои модели и проверки в обработчике тиков.
+#ifndef SIM_TESTBED_H
+#define SIM_TESTBED_H
+
+#include <stddef.h>
+
+#include "thermostat.h"
+#include "ds18b20.h"
+#include "lcd1602.h"
+#include "onewire_bus.h"
+#include "plant.h"
+
+// Шаг интегрирования модели сушилки, мс.
+#define PLANT_STEP_MS (100)
+// Предел прогрева, после которого прошивка паникует, мс.
+#define PREHEAT_LIMIT_MS (PREHEAT_LIMIT_SEC * 1000UL)
+// Серийный номер термодатчика камеры.
+#define CHAMBER_PROBE_SERIAL (0x0000DEADBEEF01ULL)
+
+struct Testbed
+{
+    explicit Testbed(const PlantParams &params = PlantParams());
+
+    // Сброс прослойки, подключение датчика и дисплея и обработчика тиков,
+    // вызываемого на каждой виртуальной миллисекунде. Запланированные
+    // действия пользователя забываются.
+    void attach(void (*on_tick)(void));
+    // Шаг модели, если now кратно PLANT_STEP_MS: нагреватель под током,
+    // если heater_on, датчик камеры получает показание модели.
+    // Возвращает true, если шаг сделан.
+    bool step(unsigned long now, bool heater_on);
+
+    Plant plant;
+    Ds18b20 probe;
+    OneWireBus bus;
+    Lcd1602 lcd;
+};
+
+// Прогон прошивки: setup() и loop(), пока обработчик тиков не
+// остановит её исключением SimulationDone.
+void run_firmware(void);
+
+// Первая ошибка прогона, пустая строка - ошибок не было.
+extern char run_failure[160];
+// Запоминает ошибку, если она первая в прогоне.
+void note_failure(const char *format, ...) __attribute__((format(printf, 1, 2)));
+// Запоминает ошибку с моментом now и останавливает прогон.
+void fail_run(unsigned long now, const char *what);
+
+// Прогоны fn для каждого пластика из filaments[], по процессу на
+// профиль; fn получает указатель на индекс пластика (int). Коды
+// завершения записываются в codes, возвращается число прогонов.
+size_t run_each_filament(int (*fn)(const void *arg), int *codes);
+// Сколько из count прогонов завершились с ненулевым кодом.
+int count_failures(const int *codes, size_t count);
+// Печатает итог сценария и возвращает код завершения процесса.
+int report_failures(int failures);
+
+#endif // SIM_TESTBED_H
@@ -0,0 +1,57 @@
+#include <stddef.h>
+
+#include <Arduino.h>
+#include <ArduinoHost.h>
+
+#include "thermostat.h"
+#include "user_input.h"
+
+// Изменение напряжения на входе энкодера в заданный момент.
+struct InputEvent
+{
+    unsigned long at_ms;
+    int value;
+};
+
+static InputEvent input_events[256];
+static size_t input_count = 0;
+static size_t input_pos = 0;
+
+void clear_inputs(void)
+{
+    input_count = input_pos = 0;
+}
+
+void schedule_input(unsigned long at_ms, int value)
+{
+    if (input_count < sizeof(input_events) / sizeof(input_events[0]))
+        input_events[input_count++] = { at_ms, value };
+}
+
+void schedule_next(unsigned long at_ms)
+{
+    schedule_input(at_ms, ADC_NEXT);
+    schedule_input(at_ms + CONTACT_MS, ADC_PREV);
+    schedule_input(at_ms + 2 * CONTACT_MS, 0);
+}
+
+void schedule_press(unsigned long at_ms)
+{
+    schedule_input(at_ms, ADC_CONFIRM);
+    schedule_input(at_ms + PRESS_MS, 0);
+}
+
+unsigned long schedule_filament_choice(int idx)
+{
+    unsigned long at_ms = MENU_START_MS;
+    for (int i = 0; i < idx; i++, at_ms += INPUT_GAP_MS)
+        schedule_next(at_ms);
+    schedule_press(at_ms);
+    return at_ms;
+}
+
+void apply_inputs(unsigned long now_ms)
+{
+    while (input_pos < input_count && input_events[input_pos].at_ms <= now_ms)
+        host_set_analog(USER_INPUT_PIN, input_events[input_pos++].value);
+}
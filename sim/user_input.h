@@ -0,0 +1,34 @@
+// Имитация пользователя: изменения напряжения на входе энкодера/кнопок,
+// запланированные на заданные моменты виртуального времени.
+#ifndef SIM_USER_INPUT_H
+#define SIM_USER_INPUT_H
+
+// Значения АЦП для контактов энкодера и кнопки (default_input_levels в прошивке).
+#define ADC_PREV (845)
+#define ADC_NEXT (697)
+#define ADC_CONFIRM (585)
+// Длительность замыкания контакта энкодера и нажатия кнопки, мс.
+#define CONTACT_MS (8)
+#define PRESS_MS (100)
+// Пауза между действиями пользователя в меню, мс.
+#define INPUT_GAP_MS (600)
+// Когда пользователь начинает выбирать пластик, мс от старта.
+#define INPUT_START_MS (2500)
+// Когда пользователь выбирает пластик в меню, мс от старта: меню
+// появляется после самопроверки при включении, а та с импульсом нагрева
+// длится до 43 с.
+#define MENU_START_MS (45000)
+
+// Забыть все запланированные действия.
+void clear_inputs(void);
+void schedule_input(unsigned long at_ms, int value);
+// Щелчок энкодера "вперёд": сначала замыкается один контакт,
+// затем, пока он замкнут, второй.
+void schedule_next(unsigned long at_ms);
+void schedule_press(unsigned long at_ms);
+// Выбор idx-го пластика в меню после старта. Возвращает момент нажатия.
+unsigned long schedule_filament_choice(int idx);
+// Подать на вход всё, что запланировано не позже now_ms.
+void apply_inputs(unsigned long now_ms);
+
+#endif // SIM_USER_INPUT_H
@@ -1,8 +1,12 @@
 #include <Arduino.h>
+#include <EEPROM.h>
+#include <Wire.h>
 #include <OneWire.h>
 #include <DallasTemperature.h>
 #include <LiquidCrystal_I2C.h>
 
+#include "thermostat.h"
+
 // Использовать вместо энкодера отдельные кнопки.
 // #define USE_BUTTONS
 
@@ -14,8 +18,96 @@
 #define ENCODER_JITTER (5)
 // Таймаут на ожидание следующего события от энкодера, мс.
 #define ENCODER_TIMEOUT (350)
+// Сколько контакты должны оставаться разомкнутыми, чтобы щелчок или
+// нажатие засчитались (с запасом на дребезг), мс.
+#define ENCODER_RELEASE (2 * ENCODER_JITTER)
+// Если щелчки энкодера в одну сторону идут чаще, чем через эти
+// интервалы, шаг изменения значения увеличивается, мс.
+#define ENCODER_MEDIUM_MS (150)
+#define ENCODER_FAST_MS (50)
 #endif
 
+// Удержание кнопки дольше этого времени - "длинное нажатие", мс.
+#define LONG_PRESS_MS (1500)
+// Пока энкодер вращают, дисплей не обновляется: вывод на него по I2C
+// занимает десятки миллисекунд, за которые можно пропустить щелчок.
+// Обновление откладывается на это время после последнего действия, мс.
+#define INPUT_REFRESH_DELAY (150)
+// Окно распознавания жестов: второе нажатие двойного щелчка или
+// вращение после нажатия должны начаться не позже, мс.
+#define GESTURE_MS (300)
+
+// Пределы изменения температуры сушки энкодером во время работы.
+#define MIN_TEMP (30)
+#define MAX_TEMP (100)
+
+// Пробой твердотельного реле: если нагреватель выключен дольше
+// RUNAWAY_SETTLE_PERIODS периодов (за это время уходит тепло, накопленное
+// нагревателем, и догоняет датчик), а температура поднялась над
+// минимумом с этого момента на RUNAWAY_RISE (1/128 °C), нагреватель греет
+// сам по себе.
+#define RUNAWAY_SETTLE_PERIODS (160)
+#define RUNAWAY_RISE (TEMP_RAW(1))
+
+// Пользовательские байты TH, TL в блокноте DS18B20.
+#define SCRATCHPAD_TH (2)
+#define SCRATCHPAD_TL (3)
+// Сколько датчиков на шине предлагается при выборе их ролей.
+#define MAX_PROBES (3)
+
+// Каскадное регулирование с датчиком на нагревателе (см. update_cascade()).
+// На сколько градусов поднимается уставка поверхности нагревателя на
+// каждый градус недогрева камеры.
+#define CASCADE_GAIN (4)
+// Интегральная часть: за период к уставке добавляется 1/2^CASCADE_I_SHIFT
+// недогрева.
+#define CASCADE_I_SHIFT (6)
+
+// Писать в Serial трассу входных сигналов (значения АЦП энкодера/кнопок,
+// блокноты термодатчика, результаты датчика влажности) и переключений
+// нагревателя. Записанную трассу
+// можно воспроизвести на хосте: program --replay FILE (см. README.md).
+// #define TRACE_RECORDER
+
+// Скорость последовательного порта (трасса, журнал отказов), бод.
+#define SERIAL_BAUD_RATE (115200)
+
+// Калибровка входа энкодера/кнопок: если при включении нажата кнопка,
+// прошивка запоминает уровни АЦП всех действий в EEPROM.
+// Адрес записи калибровки в EEPROM и её признак.
+#define CALIBRATION_ADDRESS (0)
+#define CALIBRATION_MAGIC (0xC1)
+// Ниже этого значения АЦП все контакты разомкнуты.
+#define INPUT_IDLE_LEVEL (300)
+// Уровень считается установившимся, если столько отсчётов подряд
+// отличаются от первого не больше чем на PLATEAU_TOLERANCE.
+#define PLATEAU_SAMPLES (3)
+#define PLATEAU_TOLERANCE (6)
+// Сколько контакты должны быть разомкнуты после жеста при калибровке, мс.
+#define CALIBRATION_RELEASE_MS (100)
+// Сколько жестов усреднять для каждого уровня.
+#define CALIBRATION_GESTURES (4)
+// Минимальное расстояние между уровнями разных действий, ед. АЦП.
+#define MIN_LEVEL_GAP (24)
+// Слежение за дрейфом уровней: каждый распознанный отсчёт сдвигает
+// уровень на 1/(2^DRIFT_SHIFT) расстояния до него.
+#define DRIFT_SHIFT (5)
+
+// Фильтр показаний термодатчика (см. filter_temperature()).
+// Сколько последних показаний брать для медианы.
+#define FILTER_MEDIAN (3)
+// Коэффициент сглаживания EMA: 1/2^FILTER_EMA_SHIFT.
+#define FILTER_EMA_SHIFT (2)
+// Изменение между соседними показаниями больше этого невозможно
+// для сушилки (показания идут раз в 750 мс), 1/128 °C.
+#define FILTER_MAX_STEP (TEMP_RAW(2))
+// Сколько невозможных показаний подряд отбрасывать, прежде чем
+// поверить датчику.
+#define FILTER_MAX_REJECTS (4)
+
+// Температура в единицах DallasTemperature (1/128 °C).
+#define TEMP_RAW(celsius) ((int16_t) ((celsius) * 128))
+
 // Параметры длительности сигналов азбуки Морзе, мс. >:3
 #define DOT_LEN (500)
 #define DASH_LEN (3 * DOT_LEN)
@@ -23,82 +115,192 @@
 #define LETTER_DELAY (3 * DOT_LEN)
 #define REPEAT_DELAY (7 * DOT_LEN)
 
+// Опоздание чтения датчика, после которого в журнал событий пишется
+// EventOverrun, мс.
+#define OVERRUN_MS (20)
+
+// Самопроверка при включении. Два первых показания датчика камеры
+// должны различаться не больше чем на POST_STABLE_STEP. Нагреватель
+// включается на POST_HEATER_PULSE_MS; за POST_HEATER_WINDOW_MS датчик
+// на нагревателе должен показать рост на POST_HEATER_RISE, а без него
+// датчик камеры - на POST_CHAMBER_RISE. Итог показывается POST_SHOW_MS.
+#define POST_STABLE_STEP (TEMP_RAW(1))
+#define POST_HEATER_PULSE_MS (20000)
+#define POST_HEATER_WINDOW_MS (40000)
+#define POST_HEATER_RISE (TEMP_RAW(2))
+#define POST_CHAMBER_RISE (TEMP_RAW(0.25))
+#define POST_SHOW_MS (1500)
+
+// Датчик влажности SHT3x: однократное измерение с высокой
+// повторяемостью без растяжения такта (команда 0x2400) раз в
+// HUMIDITY_PERIOD_MS, результат готов через HUMIDITY_MEASURE_MS: 15,5 мс
+// измерения по документации и миллисекунда на шаг millis(). После
+// HUMIDITY_MAX_ERRORS неудачных чтений подряд датчик отключается.
+#define SHT_MEASURE_MSB (0x24)
+#define SHT_MEASURE_LSB (0x00)
+#define HUMIDITY_PERIOD_MS (2000)
+#define HUMIDITY_MEASURE_MS (17)
+#define HUMIDITY_MAX_ERRORS (3)
+// Окончание сушки по влажности: раз в HUMIDITY_SAMPLE_SEC сушки
+// запоминается влажность; сушка заканчивается, если последние
+// HUMIDITY_PLATEAU_SAMPLES отсчётов различаются не больше чем на
+// HUMIDITY_PLATEAU_BAND (1/100 %) и влажность ниже dry_rh, но не раньше
+// HUMIDITY_MIN_SEC: катушка должна прогреться насквозь.
+#define HUMIDITY_SAMPLE_SEC (60)
+#define HUMIDITY_PLATEAU_SAMPLES (10)
+#define HUMIDITY_PLATEAU_BAND (100)
+#define HUMIDITY_MIN_SEC (1800)
+
+// Сколько изменившихся символов кадра экрана сушки уходит на дисплей
+// за один проход loop().
+#define FRAME_SLOT_CHARS (4)
+
 // Макрос для удобства записи часов.
 #define HOURS(value) (value * 3600UL)
 
-// Пин термодатчика.
-#define SENSOR_PIN (2)
-// Пин "пищалки".
-#define BEEPER_PIN (11)
-// Пин твердотельного реле управления нагревателем.
-#define HEATER_PIN (12)
-// Пин сигналов от энкодера/кнопок.
-#define USER_INPUT_PIN (A0)
-
-// Действие, произведённое энкодером/кнопками.
-enum UserInputAction
-{
-    NoAction, // Бездействие.
-    ActionNext, // Вращение в одну сторону/Следующее значение.
-    ActionPrev, // Вращение в другую сторону/Предыдущее значение.
-    ActionConfirm, // Нажатие кнопки (подтверждение выбора).
-};
-
-// Стадия (состояние) сушки.
-enum HeatingStage
-{
-    Idle, // Выключено (бездействие).
-    PreHeating, // Прогрев.
-    Working, // Стабилизация температуры.
-};
-
-// Описание настроек пластика.
-typedef struct
-{
-    const char *const name; // Название.
-    const uint8_t temp; // Температура сушки.
-    const unsigned long time_sec; // Время сушки, с.
-} Filament;
-
 // Таблица с настройками для разных видов пластика.
 const Filament filaments[] = {
     {
         .name = "PLA",
         .temp = 45,
         .time_sec = HOURS(6),
+        .dry_rh = 17,
     },
     {
         .name = "ABS",
         .temp = 60,
         .time_sec = HOURS(4),
+        .dry_rh = 9,
     },
     {
         .name = "PETG",
         .temp = 65,
         .time_sec = HOURS(4),
+        .dry_rh = 8,
     },
     {
         .name = "TPU",
         .temp = 50,
         .time_sec = HOURS(8),
+        .dry_rh = 13,
     },
     {
         .name = "Nylon",
         .temp = 70,
         .time_sec = HOURS(12),
+        .dry_rh = 7,
     },
 };
 
+// Количество записей в таблице с настройками пластиков.
+const uint8_t filaments_count = sizeof(filaments) / sizeof(filaments[0]);
+
 // Минимальный индекс таблицы с настройками пластиков.
 #define MIN_IDX (0)
 // Максимальный индекс таблицы с настройками пластиков.
 #define MAX_IDX ((sizeof(filaments) / sizeof(filaments[0])) - 1)
 
+// Уровни АЦП действий ActionNext, ActionPrev, ActionConfirm для номиналов
+// резисторов согласно схеме - если калибровки в EEPROM нет.
+const uint16_t default_input_levels[] = { 697, 845, 585 };
+
+// Запись калибровки входа в EEPROM.
+typedef struct
+{
+    uint8_t magic; // CALIBRATION_MAGIC.
+    uint16_t levels[3]; // Уровни АЦП ActionNext, ActionPrev, ActionConfirm.
+    uint8_t crc; // CRC-8 предыдущих полей.
+} InputCalibration;
+
+// Предел времени сушки при изменении энкодером, с.
+#define MAX_TIME_SEC HOURS(48)
+
+// Скорость вращения энкодера.
+enum InputSpeed
+{
+    SpeedSlow, // Отдельные щелчки.
+    SpeedMedium, // Быстрое вращение.
+    SpeedFast, // Очень быстрое вращение.
+};
+
+// Шаги изменения оставшегося времени сушки (с) и температуры
+// для каждой скорости вращения энкодера.
+const unsigned long time_steps[] = { 60, 5 * 60, 15 * 60 };
+const uint8_t temp_steps[] = { 1, 2, 5 };
+
+// Мощность нагревателя в регуляторе в 1/DUTY_ONE: DUTY_ONE - включён
+// постоянно.
+#define DUTY_ONE (256)
+
+// Точка расписания коэффициентов регулятора (см. control_heater()).
+typedef struct
+{
+    uint8_t temp; // Уставка, °C.
+    uint8_t preheat_kp; // П-коэффициент прогрева, мощность на °C.
+    uint8_t hold_kp; // П-коэффициент поддержания, мощность на °C.
+    uint8_t hold_ki; // И-коэффициент, мощность/256 на °C за период.
+    uint8_t bias; // Мощность, держащая уставку в комнате 22 °C.
+} GainPoint;
+
+// Расписание коэффициентов по уставке, по возрастанию температуры.
+// Между точками коэффициенты интерполируются линейно.
+const GainPoint gain_schedule[] = {
+    { 30, 64, 128, 80, 25 },
+    { 50, 80, 128, 80, 86 },
+    { 70, 128, 128, 80, 147 },
+    { 100, 255, 128, 80, 240 },
+};
+const uint8_t gain_points = sizeof(gain_schedule) / sizeof(gain_schedule[0]);
+
+// Упреждение по датчику в комнате: мощность, возмещающая потери через
+// стенки, (уставка - комната) * FEEDFORWARD_GAIN / 2^15 в 1/DUTY_ONE на
+// 1/128 °C. Потери 1.2 Вт/°C при нагревателе 100 Вт - 3.07 на °C, как
+// наклон bias в gain_schedule.
+#define FEEDFORWARD_GAIN (786)
+// Сглаживание показаний датчика в комнате: 1/2^AMBIENT_EMA_SHIFT.
+#define AMBIENT_EMA_SHIFT (4)
+
 // Настройка шины 1-wire и термодатчика DS18B20.
 OneWire ow_bus(SENSOR_PIN);
 DallasTemperature sensor(&ow_bus);
 // Настройка LCD-дисплея 1602.
-LiquidCrystal_I2C screen(0x27, 16, 2);
+LiquidCrystal_I2C screen(LCD_ADDRESS, 16, 2);
+
+// Кадр экрана сушки. update_screen() печатает в него, как в дисплей, а
+// flush_frame() переносит на дисплей только изменившиеся символы,
+// понемногу за проход loop() (см. run_bus()).
+class ScreenFrame : public Print
+{
+public:
+    // Нужный текст и то, что сейчас на дисплее.
+    char text[2][16];
+    char shown[2][16];
+    uint8_t col = 0;
+    uint8_t row = 0;
+
+    void setCursor(const uint8_t new_col, const uint8_t new_row)
+    {
+        col = new_col;
+        row = new_row;
+    }
+
+    // Символы за последним столбцом не видны и отбрасываются.
+    size_t write(uint8_t value)
+    {
+        if (col < 16)
+            text[row][col++] = value;
+        return 1;
+    }
+    using Print::write;
+
+    // Дисплей очищен: на нём и в кадре пробелы.
+    void reset(void)
+    {
+        memset(text, ' ', sizeof(text));
+        memset(shown, ' ', sizeof(shown));
+    }
+};
+ScreenFrame frame;
 
 // Выбранный пластик.
 volatile const Filament *filament = NULL;
@@ -113,11 +315,152 @@ volatile bool heater_is_on = false;
 volatile bool input_event_occurred = false;
 // Текущая стадия сушки.
 volatile HeatingStage heating_stage = Idle;
+// Флаг паузы: нагрев выключен, счётчик секунд остановлен.
+volatile bool paused = false;
+// Температура и время сушки. Копируются из выбранного пластика и
+// могут меняться энкодером во время сушки.
+uint8_t target_temp = 0;
+unsigned long target_time_sec = 0;
+// Уровни АЦП действий (индекс - действие минус 1) в 1/16 единицы АЦП,
+// чтобы следить за медленным дрейфом.
+uint16_t input_levels[3];
+// Уровни, по которым построена таблица input_table.
+uint16_t table_levels[3];
+// Таблица распознавания действий: 2 бита (UserInputAction) на каждые
+// 4 единицы АЦП, всего 64 байта.
+uint8_t input_table[(1024 / 4) * 2 / 8];
+// Скорость вращения энкодера при последнем распознанном щелчке.
+InputSpeed input_speed = SpeedSlow;
+// Момент последнего действия энкодера/кнопок во время сушки.
+unsigned long last_input_time = 0;
+// Нажатие, которое ещё может стать частью жеста, и его момент.
+bool gesture_click = false;
+unsigned long gesture_time = 0;
+// Идёт вращение после нажатия (ActionShiftNext/ActionShiftPrev).
+bool gesture_shift = false;
+// Включена ли подсветка дисплея.
+bool backlight_on = true;
+// Последняя измеренная температура, 0 - ещё не измерялась.
+uint8_t current_temp = 0;
+// Время преобразования термодатчика, мс, и момент запуска последнего
+// преобразования.
+uint16_t conversion_ms = 0;
+unsigned long conversion_start = 0;
+// Состояние фильтра показаний термодатчика, 1/128 °C: последние
+// показания, позиция для следующего, отфильтрованное значение и число
+// отброшенных подряд показаний.
+int16_t filter_window[FILTER_MEDIAN];
+uint8_t filter_pos = 0;
+int16_t filter_value = 0;
+uint8_t filter_rejects = 0;
+bool filter_started = false;
+// Состояние наблюдателя температуры камеры и история нагревателя за
+// последние 16 периодов (младший бит - последний период).
+int32_t observer_chamber = 0;
+int32_t observer_sensor = 0;
+int32_t observer_drift = 0;
+uint16_t observer_heating = 0;
+bool observer_started = false;
+// Адрес термодатчика на шине и флаг, что он найден.
+DeviceAddress sensor_address;
+bool sensor_found = false;
+// Адрес датчика на нагревателе, флаг, что он есть, и его показание,
+// 1/128 °C.
+DeviceAddress heater_address;
+bool heater_probe = false;
+int16_t heater_raw = 0;
+// Интегральная часть регулятора, DUTY_ONE/256, и накопитель
+// широтно-импульсного выхода.
+int32_t control_integral = 0;
+uint16_t duty_accumulator = 0;
+bool control_started = false;
+// Адрес датчика в комнате, флаг, что он есть, и сглаженное показание,
+// 1/128 °C.
+DeviceAddress ambient_address;
+bool ambient_probe = false;
+bool ambient_started = false;
+int16_t ambient_raw = 0;
+// Чей черёд читаться среди дополнительных датчиков.
+bool probe_turn = false;
+// Сколько периодов подряд нагреватель выключен (до
+// RUNAWAY_SETTLE_PERIODS) и наименьшая температура после этого.
+uint8_t off_periods = 0;
+int16_t off_min_temp = 0;
+// Уставка поверхности нагревателя и её интегральная часть, 1/128 °C.
+int16_t heater_setpoint = 0;
+int16_t cascade_integral = 0;
+// Причина паники и её сообщение. Запоминаются, чтобы их можно было
+// прочитать извне (например, при запуске прошивки на хосте).
+volatile PanicCode panic_code = NoPanic;
+const char *volatile panic_reason = NULL;
+// Сообщения для кодов паники, не длиннее строки дисплея. И они, и
+// таблица указателей на них лежат во флеш-памяти (см. panic_message()).
+const char panic_sensor_lost[] PROGMEM = "Temp NaN.";
+const char panic_frozen[] PROGMEM = "Frozen.";
+const char panic_burned[] PROGMEM = "Burned.";
+const char panic_heater_state[] PROGMEM = "Heater state.";
+const char panic_preheating[] PROGMEM = "Preheating.";
+const char panic_heater_stuck[] PROGMEM = "Heater stuck on.";
+const char panic_no_heat[] PROGMEM = "No heat.";
+const char *const panic_messages[] PROGMEM = {
+    NULL,
+    panic_sensor_lost,
+    panic_frozen,
+    panic_burned,
+    panic_heater_state,
+    panic_preheating,
+    panic_heater_stuck,
+    panic_no_heat,
+};
+// Сигнал 'S.O.S' азбукой Морзе: длительности звука и пауз по очереди,
+// начиная со звука, мс.
+const uint16_t alarm_pattern[] = {
+    DOT_LEN, SIGN_DELAY, DOT_LEN, SIGN_DELAY, DOT_LEN, LETTER_DELAY, // 'S': ...
+    DASH_LEN, SIGN_DELAY, DASH_LEN, SIGN_DELAY, DASH_LEN, LETTER_DELAY, // 'O': ---
+    DOT_LEN, SIGN_DELAY, DOT_LEN, SIGN_DELAY, DOT_LEN, LETTER_DELAY + REPEAT_DELAY, // 'S': ...
+};
+const uint8_t alarm_steps = sizeof(alarm_pattern) / sizeof(alarm_pattern[0]);
+// Причина сброса (MCUSR) при запуске.
+uint8_t reset_cause = 0;
+// Итог самопроверки при включении (биты SelfTestFailure).
+uint8_t self_test_failures = 0;
+// Датчик влажности: отвечает ли он, идёт ли измерение и когда оно
+// начато, сколько чтений подряд не удалось, последняя влажность
+// (1/100 %) и есть ли она.
+bool humidity_sensor = false;
+bool humidity_measuring = false;
+unsigned long humidity_start = 0;
+uint8_t humidity_errors = 0;
+uint16_t chamber_rh = 0;
+bool humidity_valid = false;
+// Отсчёты влажности для поиска плато: кольцо, следующая ячейка,
+// сколько заполнено и когда (seconds) взят последний.
+uint16_t rh_samples[HUMIDITY_PLATEAU_SAMPLES];
+uint8_t rh_next = 0;
+uint8_t rh_count = 0;
+unsigned long rh_sample_sec = 0;
+// Кольцо событий для журнала перед отказом. Не обнуляется при запуске
+// (.noinit), чтобы пережить сброс сторожевым таймером или кнопкой;
+// event_magic отличает сохранившееся кольцо от мусора после включения.
+#ifdef ARDUINO_HOST
+#define NOINIT
+#else
+#define NOINIT __attribute__((section(".noinit")))
+#endif
+#define EVENT_MAGIC (0x4D50)
+PostMortemEvent event_ring[POSTMORTEM_EVENTS] NOINIT;
+uint8_t event_head NOINIT;
+uint16_t event_magic NOINIT;
+// Шаг сигнала, момент его начала и флаг, что сигнал заглушён.
+uint8_t alarm_step = 0;
+unsigned long alarm_start = 0;
+bool alarm_muted = false;
 
 // Обработчик прерывания от таймера. Срабатывает 1 раз в секунду.
 ISR(TIMER1_COMPA_vect)
 {
-    seconds++;
+    if (!paused)
+        seconds++;
     refresh_screen = true;
 }
 
@@ -129,6 +472,100 @@ ISR(PCINT1_vect)
     input_event_occurred = true;
 }
 
+#ifdef TRACE_RECORDER
+// Формат трассы - текстовые строки "<тип> <мс от старта> <данные>":
+//   A <ms> <значение АЦП>      - изменилось действие на входе энкодера;
+//   S <ms> <18 hex-цифр>       - прочитан блокнот термодатчика;
+//   S <ms> -                   - термодатчик не найден на шине;
+//   P <ms> <число>             - поиск нашёл столько датчиков (их
+//                                блокноты - предыдущие строки S);
+//   R <ms> <12 hex-цифр>       - прочитан результат датчика влажности;
+//   R <ms> -                   - датчик влажности не ответил на чтение;
+//   H <ms> <0|1>               - нагреватель выключен/включен;
+//   E <ms> <камера>,<датчик>,<дрейф> - оценки наблюдателя.
+void trace_begin(const char kind)
+{
+    Serial.print(kind);
+    Serial.print(' ');
+    Serial.print(millis());
+    Serial.print(' ');
+}
+
+// АЦП опрашивается постоянно, поэтому пишем значение только когда
+// меняется распознанное действие или сторона порога прерывания PCINT.
+void trace_adc(const int value, const UserInputAction action)
+{
+    static int last_key = -1;
+    const int key = action * 2 + (value >= 512 ? 1 : 0);
+    if (key == last_key)
+        return;
+    last_key = key;
+    trace_begin('A');
+    Serial.println(value);
+}
+
+void trace_scratchpad(const uint8_t *const scratchpad)
+{
+    trace_begin('S');
+    if (scratchpad == NULL) {
+        Serial.println('-');
+        return;
+    }
+    for (uint8_t i = 0; i < 9; i++) {
+        if (scratchpad[i] < 0x10)
+            Serial.print('0');
+        Serial.print(scratchpad[i], HEX);
+    }
+    Serial.println();
+}
+
+void trace_humidity(const uint8_t *const data)
+{
+    trace_begin('R');
+    if (data == NULL) {
+        Serial.println('-');
+        return;
+    }
+    for (uint8_t i = 0; i < 6; i++) {
+        if (data[i] < 0x10)
+            Serial.print('0');
+        Serial.print(data[i], HEX);
+    }
+    Serial.println();
+}
+
+void trace_probes(const uint8_t count)
+{
+    trace_begin('P');
+    Serial.println(count);
+}
+
+void trace_heater(const bool on)
+{
+    if (on == heater_is_on)
+        return;
+    trace_begin('H');
+    Serial.println(on ? 1 : 0);
+}
+
+void trace_observer(void)
+{
+    trace_begin('E');
+    Serial.print(observer_chamber);
+    Serial.print(',');
+    Serial.print(observer_sensor);
+    Serial.print(',');
+    Serial.println(observer_drift);
+}
+#else
+#define trace_adc(value, action)
+#define trace_scratchpad(scratchpad)
+#define trace_humidity(data)
+#define trace_probes(count)
+#define trace_heater(on)
+#define trace_observer()
+#endif // TRACE_RECORDER
+
 // Сброс таймера.
 void reset_timer(void)
 {
@@ -140,9 +577,25 @@ void reset_timer(void)
     interrupts();
 }
 
-// Включение нагрева.
+// Запись события в кольцо: несколько пересылок, без запрета прерываний
+// (события пишет только основной цикл).
+void record_event(const EventKind kind, const uint8_t data)
+{
+    PostMortemEvent &event = event_ring[event_head++ % POSTMORTEM_EVENTS];
+    event.time = millis() >> POSTMORTEM_TICK_SHIFT;
+    event.kind = kind;
+    event.data = data;
+}
+
+// Включение нагрева. После паники нагрев не включается, пока она не
+// снята.
 void turn_on(void)
 {
+    if (panic_code != NoPanic)
+        return;
+    if (!heater_is_on)
+        record_event(EventHeater, 1);
+    trace_heater(true);
     digitalWrite(HEATER_PIN, HIGH);
     heater_is_on = true;
 }
@@ -150,10 +603,26 @@ void turn_on(void)
 // Выключение нагрева.
 void turn_off(void)
 {
+    if (heater_is_on)
+        record_event(EventHeater, 0);
+    trace_heater(false);
     digitalWrite(HEATER_PIN, LOW);
     heater_is_on = false;
 }
 
+// Отсекающее реле замкнуто только во время сушки и импульса
+// самопроверки, когда датчик опрашивается и пробой реле заметен. В меню
+// и после окончания сушки пробитое реле грело бы без присмотра.
+void cut_off(void)
+{
+    digitalWrite(CUTOFF_PIN, LOW);
+}
+
+void close_cutoff(void)
+{
+    digitalWrite(CUTOFF_PIN, HIGH);
+}
+
 // Пищание "пищалкой".
 void beep(uint16_t duration)
 {
@@ -167,65 +636,578 @@ void clear_screen(void)
 {
     screen.clear();
     screen.home();
+    frame.reset();
+}
+
+// Перенос на дисплей не больше limit изменившихся символов кадра.
+// Подряд идущие символы пишутся без повторной установки курсора.
+void flush_frame(uint8_t limit)
+{
+    for (uint8_t row = 0; row < 2; row++) {
+        bool positioned = false;
+        for (uint8_t col = 0; col < 16; col++) {
+            if (frame.text[row][col] == frame.shown[row][col]) {
+                positioned = false;
+                continue;
+            }
+            if (limit == 0)
+                return;
+            if (!positioned)
+                screen.setCursor(col, row);
+            positioned = true;
+            screen.write(frame.text[row][col]);
+            frame.shown[row][col] = frame.text[row][col];
+            limit--;
+        }
+    }
+}
+
+// Адрес ячейки журнала отказов.
+int fault_address(const uint8_t slot)
+{
+    return FAULT_LOG_ADDRESS + slot * sizeof(FaultRecord);
+}
+
+// Чтение ячейки журнала. Возвращает false, если она пуста или испорчена.
+bool read_fault_slot(const uint8_t slot, FaultRecord *const record)
+{
+    EEPROM.get(fault_address(slot), *record);
+    return OneWire::crc8((const uint8_t *) record, offsetof(FaultRecord, crc)) == record->crc;
+}
+
+// Ячейка самой свежей записи журнала или FAULT_LOG_SIZE, если журнал
+// пуст. Свежая - та, за которой нет записи со следующим номером.
+uint8_t newest_fault_slot(void)
+{
+    FaultRecord record, next;
+    bool next_valid = read_fault_slot(0, &next);
+
+    for (uint8_t slot = FAULT_LOG_SIZE; slot > 0; slot--) {
+        // Идём от последней ячейки к первой: next - ячейка за slot - 1.
+        const bool valid = read_fault_slot(slot - 1, &record);
+        if (valid && (!next_valid || (uint8_t) (record.sequence + 1) != next.sequence))
+            return slot - 1;
+        next = record;
+        next_valid = valid;
+    }
+    return FAULT_LOG_SIZE;
+}
+
+// Запись журнала: age 0 - самая свежая. Возвращает false, если
+// столько записей нет.
+bool read_fault(const uint8_t age, FaultRecord *const record)
+{
+    const uint8_t newest = newest_fault_slot();
+    if (newest == FAULT_LOG_SIZE || age >= FAULT_LOG_SIZE)
+        return false;
+    const uint8_t slot = (newest + FAULT_LOG_SIZE - age) % FAULT_LOG_SIZE;
+    if (!read_fault_slot(slot, record))
+        return false;
+    // Ячейки старше самой старой записи пусты или от прошлого круга.
+    FaultRecord newest_record;
+    read_fault_slot(newest, &newest_record);
+    return (uint8_t) (newest_record.sequence - record->sequence) == age;
+}
+
+// Запись в журнал отказов причины code и состояния сушилки. EEPROM.put()
+// переписывает только изменившиеся байты.
+void log_fault(const PanicCode code)
+{
+    FaultRecord record;
+    const uint8_t newest = newest_fault_slot();
+    uint8_t sequence = 0;
+    if (newest != FAULT_LOG_SIZE && read_fault_slot(newest, &record))
+        sequence = record.sequence + 1;
+
+    record.sequence = sequence;
+    record.code = code;
+    record.stage = heating_stage;
+    record.reset_cause = reset_cause;
+    noInterrupts();
+    const unsigned long elapsed = seconds;
+    interrupts();
+    record.minutes = constrain(elapsed / 60, 0UL, 0xFFFFUL);
+    record.sensor = filter_value;
+    record.estimate = observer_chamber >> OBSERVER_SHIFT;
+    record.target = target_temp;
+    record.crc = OneWire::crc8((const uint8_t *) &record, offsetof(FaultRecord, crc));
+    EEPROM.put(fault_address(newest == FAULT_LOG_SIZE ? 0 : (newest + 1) % FAULT_LOG_SIZE), record);
+}
+
+// Очистка журнала отказов.
+void clear_fault_log(void)
+{
+    for (int address = fault_address(0); address < fault_address(FAULT_LOG_SIZE); address++)
+        EEPROM.update(address, 0xFF);
+}
+
+// Сообщение для кода паники.
+const __FlashStringHelper *panic_message(const uint8_t code)
+{
+    return (const __FlashStringHelper *) pgm_read_ptr(&panic_messages[code % (PanicNoHeat + 1)]);
+}
+
+// Запись size байтов в EEPROM начиная с *address. Возвращает CRC-8,
+// продолженную с crc по записанным байтам: CRC предыдущих байтов
+// подмешивается в очередной байт, так что OneWire::crc8() по одному
+// байту даёт то же, что по всему блоку сразу.
+uint8_t put_with_crc(int *const address, const uint8_t *data, uint8_t size, uint8_t crc)
+{
+    while (size--) {
+        const uint8_t mixed = crc ^ *data;
+        EEPROM.update((*address)++, *data++);
+        crc = OneWire::crc8(&mixed, 1);
+    }
+    return crc;
+}
+
+// Сохранение кольца событий в EEPROM с причиной reason. Заголовок и
+// кольцо пишутся прямо на место PostMortem, CRC считается на ходу:
+// копия записи (133 байта) на стеке паники не нужна.
+void save_postmortem(const PanicCode reason)
+{
+    static_assert(offsetof(PostMortem, events) == 4 && offsetof(PostMortem, crc) == 4 + sizeof(event_ring),
+        "PostMortem layout");
+    const uint8_t header[] = { POSTMORTEM_VERSION, reason, reset_cause, (uint8_t) (event_head % POSTMORTEM_EVENTS) };
+    int address = POSTMORTEM_ADDRESS;
+    uint8_t crc = put_with_crc(&address, header, sizeof(header), 0);
+    crc = put_with_crc(&address, (const uint8_t *) event_ring, sizeof(event_ring), crc);
+    EEPROM.update(address, crc);
+}
+
+// Чтение сохранённого кольца событий. Возвращает false, если его нет.
+bool read_postmortem(PostMortem *const record)
+{
+    EEPROM.get(POSTMORTEM_ADDRESS, *record);
+    return record->version == POSTMORTEM_VERSION
+        && OneWire::crc8((const uint8_t *) record, offsetof(PostMortem, crc)) == record->crc;
 }
 
 // Обработчик ошибок.
-// Аргументом получает сообщение об ошибке.
-// Играет "пищалкой" сигнал 'S.O.S' азбукой Морзе.
-void panic(const char *const reason)
+// Аргументом получает причину ошибки.
+// Выключает нагреватель и размыкает отсекающее реле: твердотельное реле
+// могло отказать замкнутым. Дальше loop() работает в состоянии паники
+// (см. handle_panic()): нагрев запрещён, температура по-прежнему
+// читается и показывается, "пищалка" в фоне играет сигнал 'S.O.S'.
+// Повторная паника до снятия первой только выключает нагрев.
+void panic(const PanicCode code)
 {
     turn_off();
+    cut_off();
+    if (panic_code != NoPanic)
+        return;
+    panic_code = code;
+    panic_reason = (const char *) panic_message(code);
+    record_event(EventPanic, code);
+    log_fault(code);
+    save_postmortem(code);
+
+    alarm_step = 0;
+    alarm_start = millis();
+    alarm_muted = false;
+    digitalWrite(BEEPER_PIN, HIGH);
 
     clear_screen();
+    screen.print(panic_message(code));
+}
 
-    screen.setCursor(0, 0);
-    screen.print("PANIC! Reason:");
-    screen.setCursor(0, 1);
-    screen.print(reason);
+// Фоновый сигнал паники: переключает "пищалку" по alarm_pattern.
+void play_alarm(void)
+{
+    if (alarm_muted || millis() - alarm_start < alarm_pattern[alarm_step])
+        return;
+    alarm_start += alarm_pattern[alarm_step];
+    alarm_step = (alarm_step + 1) % alarm_steps;
+    digitalWrite(BEEPER_PIN, alarm_step % 2 == 0 ? HIGH : LOW);
+}
 
-    for (;;) {
-        // 'S': ...
-        beep(DOT_LEN);
-        delay(SIGN_DELAY);
-        beep(DOT_LEN);
-        delay(SIGN_DELAY);
-        beep(DOT_LEN);
-        delay(LETTER_DELAY);
-        // 'O': ---
-        beep(DASH_LEN);
-        delay(SIGN_DELAY);
-        beep(DASH_LEN);
-        delay(SIGN_DELAY);
-        beep(DASH_LEN);
-        delay(LETTER_DELAY);
-        // 'S': ...
-        beep(DOT_LEN);
-        delay(SIGN_DELAY);
-        beep(DOT_LEN);
-        delay(SIGN_DELAY);
-        beep(DOT_LEN);
-        delay(LETTER_DELAY);
-
-        delay(REPEAT_DELAY);
-    }
-}
-
-// Получение текущей температуры с термодатчика.
-uint8_t query_sensor(void)
+// Запуск преобразования температуры. Не дожидается его окончания:
+// результат читается через conversion_ms функцией query_sensor().
+void start_conversion(void)
 {
     sensor.requestTemperatures();
-    const float value = sensor.getTempCByIndex(0);
+    conversion_start = millis();
+}
+
+// Ожидание окончания преобразования, начатого start_conversion().
+void wait_conversion(void)
+{
+    const unsigned long elapsed = millis() - conversion_start;
+    if (elapsed < conversion_ms)
+        delay(conversion_ms - elapsed);
+}
 
-    if (value == DEVICE_DISCONNECTED_C)
-        panic("Temp NaN.");
+// Фильтр показаний термодатчика, только целочисленная арифметика.
+// Показание, отличающееся от текущего значения больше чем на
+// FILTER_MAX_STEP, отбрасывается как невозможное. Если таких набралось
+// больше FILTER_MAX_REJECTS подряд, значит температура действительно
+// другая (или датчик неисправен, и это должны увидеть проверки
+// "Frozen."/"Burned.") - фильтр начинает заново с нового показания.
+// Остальные показания проходят медиану последних FILTER_MEDIAN (убирает
+// одиночные выбросы), затем EMA.
+int16_t filter_temperature(const int16_t raw)
+{
+    const bool jump = abs(raw - filter_value) > FILTER_MAX_STEP;
 
-    const uint8_t temp = ((unsigned int) value) & 0xFF;
-    if (temp <= 1)
-        panic("Frozen.");
-    if (temp >= 120)
-        panic("Burned.");
+    if (filter_started && jump && filter_rejects < FILTER_MAX_REJECTS) {
+        filter_rejects++;
+        record_event(EventSensorError, SensorRejected);
+        return filter_value;
+    }
+    filter_rejects = 0;
+
+    if (!filter_started || jump) {
+        for (uint8_t i = 0; i < FILTER_MEDIAN; i++)
+            filter_window[i] = raw;
+        filter_value = raw;
+        filter_started = true;
+        return filter_value;
+    }
 
-    return temp;
+    filter_window[filter_pos] = raw;
+    if (++filter_pos == FILTER_MEDIAN)
+        filter_pos = 0;
+
+    // Медиана: сортировка вставками копии окна.
+    int16_t sorted[FILTER_MEDIAN];
+    for (uint8_t i = 0; i < FILTER_MEDIAN; i++) {
+        const int16_t value = filter_window[i];
+        uint8_t j = i;
+        for (; j > 0 && sorted[j - 1] > value; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = value;
+    }
+
+    filter_value += (sorted[FILTER_MEDIAN / 2] - filter_value) >> FILTER_EMA_SHIFT;
+    return filter_value;
+}
+
+// Наблюдатель температуры камеры: датчик в корпусе отстаёт от воздуха
+// на десятки секунд, и регулятор по его показаниям перегревает камеру.
+// Вызывается раз в период с отфильтрованным показанием (1/128 °C) и
+// состоянием нагревателя за прошедший период. Прогноз по модели (см.
+// OBSERVER_PERIOD_MS) поправляется на расхождение прогноза датчика с
+// показанием с установившимися коэффициентами фильтра Калмана: матрица
+// ковариаций для постоянной модели сходится к постоянной, её считает
+// хост, а прошивке остаются три умножения.
+void update_observer(const int16_t measured, const bool heating)
+{
+    if (!observer_started) {
+        observer_chamber = observer_sensor = (int32_t) measured << OBSERVER_SHIFT;
+        observer_drift = 0;
+        observer_heating = 0;
+        observer_started = true;
+        return;
+    }
+
+    observer_heating = (observer_heating << 1) | (heating ? 1 : 0);
+    observer_sensor += (observer_chamber - observer_sensor) * OBSERVER_LAG >> OBSERVER_GAIN_SHIFT;
+    observer_chamber += observer_drift;
+    if (observer_heating & (1 << OBSERVER_DEAD_PERIODS))
+        observer_chamber += OBSERVER_HEAT;
+
+    // Расхождение ограничено, чтобы произведения помещались в int32.
+    const int32_t error = constrain(measured - (observer_sensor >> OBSERVER_SHIFT), -TEMP_RAW(64), TEMP_RAW(64));
+    const uint8_t shift = OBSERVER_GAIN_SHIFT - OBSERVER_SHIFT;
+    observer_chamber += error * OBSERVER_GAIN_CHAMBER >> shift;
+    observer_sensor += error * OBSERVER_GAIN_SENSOR >> shift;
+    observer_drift += error * OBSERVER_GAIN_DRIFT >> shift;
+    trace_observer();
+}
+
+// Каскадное регулирование: внешний контур (ПИ по оценке температуры
+// камеры) задаёт уставку поверхности нагревателя, внутренний держит
+// поверхность не выше неё, ограничивая мощность от control_heater().
+// Далеко от уставки камеры поверхность греется до HEATER_MAX_TEMP,
+// ближе к ней - всё меньше, и тепло, накопленное в нагревателе, не
+// перегревает камеру. Интегральная часть подбирает, насколько
+// поверхность должна быть горячее камеры, чтобы покрыть потери; пока
+// уставка упирается в пределы, она не копится.
+void update_cascade(void)
+{
+    const int16_t target = TEMP_RAW(target_temp);
+    const int16_t ceiling = TEMP_RAW(HEATER_MAX_TEMP);
+    const int16_t error = target - (observer_chamber >> OBSERVER_SHIFT);
+    const int32_t setpoint = target + (int32_t) error * CASCADE_GAIN + cascade_integral;
+
+    if ((setpoint < ceiling || error < 0) && (setpoint > target || error > 0))
+        cascade_integral = constrain(cascade_integral + (error >> CASCADE_I_SHIFT), 0, ceiling - target);
+    heater_setpoint = constrain(setpoint, target, ceiling);
+}
+
+// Оценка температуры камеры, °C.
+uint8_t observer_celsius(void)
+{
+    return constrain(observer_chamber >> (OBSERVER_SHIFT + 7), 0, 255);
+}
+
+// Проверка на пробой твердотельного реле по отфильтрованному показанию
+// temp (1/128 °C) и состоянию нагревателя за прошедший период: при
+// выключенном нагревателе температура может только падать. При пробое
+// размыкается отсекающее реле.
+void check_heater_runaway(const int16_t temp)
+{
+    if (heater_is_on) {
+        off_periods = 0;
+        return;
+    }
+    if (off_periods < RUNAWAY_SETTLE_PERIODS) {
+        off_periods++;
+        off_min_temp = temp;
+        return;
+    }
+    if (temp < off_min_temp)
+        off_min_temp = temp;
+    else if (temp - off_min_temp >= RUNAWAY_RISE)
+        panic(PanicHeaterStuck);
+}
+
+// Поиск термодатчиков на шине. Датчики на нагревателе и в комнате
+// отмечены HEATER_PROBE_MARK и AMBIENT_PROBE_MARK в пользовательских
+// байтах, первый из остальных - датчик камеры. Блокноты читаются здесь,
+// а не getUserData(), чтобы попасть в трассу.
+void find_probes(void)
+{
+    DeviceAddress address;
+    uint8_t scratchpad[9];
+
+    sensor_found = false;
+    heater_probe = false;
+    ambient_probe = false;
+    uint8_t count = 0;
+    for (; sensor.getAddress(address, count); count++) {
+        const bool connected = sensor.isConnected(address, scratchpad);
+        trace_scratchpad(scratchpad);
+        if (!connected)
+            continue;
+        const int16_t mark = (scratchpad[SCRATCHPAD_TH] << 8) | scratchpad[SCRATCHPAD_TL];
+        if (mark == HEATER_PROBE_MARK) {
+            memcpy(heater_address, address, sizeof(address));
+            heater_probe = true;
+        } else if (mark == AMBIENT_PROBE_MARK) {
+            memcpy(ambient_address, address, sizeof(address));
+            ambient_probe = true;
+            ambient_started = false;
+        } else if (!sensor_found) {
+            memcpy(sensor_address, address, sizeof(address));
+            sensor_found = true;
+        }
+    }
+    trace_probes(count);
+}
+
+// Чтение дополнительного датчика, 1/128 °C. Возвращает false, если он
+// не ответил.
+bool query_probe(const uint8_t *const address, int16_t *const raw)
+{
+    uint8_t scratchpad[9];
+
+    const bool connected = sensor.isConnected(address, scratchpad);
+    trace_scratchpad(scratchpad);
+    if (connected)
+        *raw = sensor.calculateTemperature(address, scratchpad);
+    return connected;
+}
+
+// Установка (selected) или снятие метки mark в пользовательских байтах
+// датчика - как setUserData(), но блокнот читается здесь, чтобы попасть
+// в трассу.
+void update_probe_mark(const uint8_t *const address, const int16_t mark, const bool selected)
+{
+    uint8_t scratchpad[9];
+
+    const bool connected = sensor.isConnected(address, scratchpad);
+    trace_scratchpad(scratchpad);
+    if (!connected)
+        return;
+    const int16_t current = (scratchpad[SCRATCHPAD_TH] << 8) | scratchpad[SCRATCHPAD_TL];
+    if (selected == (current == mark))
+        return;
+    const int16_t value = selected ? mark : 0;
+    scratchpad[SCRATCHPAD_TH] = (uint16_t) value >> 8;
+    scratchpad[SCRATCHPAD_TL] = value & 0xFF;
+    sensor.writeScratchPad(address, scratchpad);
+}
+
+// Дополнительные датчики читаются по очереди, по одному за период,
+// чтобы опрос шины не рос с их числом. Датчик, который не ответил,
+// отключается до следующего поиска датчиков: каскад и упреждение
+// перестают работать, регулирование по камере остаётся.
+void query_aux_probes(void)
+{
+    probe_turn = !probe_turn;
+    if (heater_probe && (probe_turn || !ambient_probe)) {
+        heater_probe = query_probe(heater_address, &heater_raw);
+        if (!heater_probe)
+            record_event(EventSensorError, SensorAuxLost);
+    } else if (ambient_probe) {
+        int16_t raw = 0;
+        ambient_probe = query_probe(ambient_address, &raw);
+        if (!ambient_probe) {
+            record_event(EventSensorError, SensorAuxLost);
+            return;
+        }
+        // Комната меняется медленно, показание сглаживается.
+        if (!ambient_started)
+            ambient_raw = raw;
+        ambient_raw += (raw - ambient_raw) >> AMBIENT_EMA_SHIFT;
+        ambient_started = true;
+    }
+}
+
+// Чтение температуры, измеренной после start_conversion().
+// То же, что getTempCByIndex(0), но с доступом к прочитанному блокноту.
+// Адреса термодатчиков запоминаются: поиск на шине занимает больше 10 мс,
+// на это время останавливался бы опрос энкодера. Если датчик камеры
+// перестал отвечать, при следующем чтении датчики ищутся заново.
+// Возвращает температуру в °C или 0, если показание вызвало панику.
+uint8_t query_sensor(void)
+{
+    uint8_t scratchpad[9] = { 0 };
+    int16_t raw = DEVICE_DISCONNECTED_RAW;
+
+    if (!sensor_found)
+        find_probes();
+    query_aux_probes();
+    if (sensor_found) {
+        const bool connected = sensor.isConnected(sensor_address, scratchpad);
+        trace_scratchpad(scratchpad);
+        if (connected)
+            raw = sensor.calculateTemperature(sensor_address, scratchpad);
+        else
+            sensor_found = false;
+    } else {
+        trace_scratchpad(NULL);
+    }
+    if (raw == DEVICE_DISCONNECTED_RAW) {
+        record_event(EventSensorError, SensorNoAnswer);
+        panic(PanicSensorLost);
+        return 0;
+    }
+
+    const int16_t value = filter_temperature(raw);
+    if (value < TEMP_RAW(2)) {
+        panic(PanicFrozen);
+        return 0;
+    }
+    if (value >= TEMP_RAW(120)) {
+        panic(PanicBurned);
+        return 0;
+    }
+
+    return value >> 7;
+}
+
+// CRC-8 слова данных SHT3x: полином 0x31, начальное значение 0xFF.
+uint8_t sht_crc8(const uint8_t *data, uint8_t len)
+{
+    uint8_t crc = 0xFF;
+
+    while (len--) {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++)
+            crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+    return crc;
+}
+
+// Неудачное обращение к датчику влажности. После HUMIDITY_MAX_ERRORS
+// подряд он отключается до перезапуска, сушка идёт по времени.
+void humidity_failed(void)
+{
+    if (++humidity_errors < HUMIDITY_MAX_ERRORS)
+        return;
+    humidity_sensor = false;
+    humidity_valid = false;
+    record_event(EventSensorError, SensorHumidityLost);
+}
+
+// Один шаг опроса датчика влажности: запуск измерения, когда подошёл
+// период, или чтение результата, когда оно закончилось. Пока измерение
+// идёт, шина свободна. Возвращает true, если была транзакция на шине.
+bool poll_humidity(void)
+{
+    if (!humidity_sensor)
+        return false;
+
+    if (!humidity_measuring) {
+        if (millis() - humidity_start < HUMIDITY_PERIOD_MS)
+            return false;
+        humidity_start = millis();
+        Wire.beginTransmission(HUMIDITY_ADDRESS);
+        Wire.write(SHT_MEASURE_MSB);
+        Wire.write(SHT_MEASURE_LSB);
+        humidity_measuring = Wire.endTransmission() == 0;
+        if (!humidity_measuring)
+            humidity_failed();
+        return true;
+    }
+
+    if (millis() - humidity_start < HUMIDITY_MEASURE_MS)
+        return false;
+    humidity_measuring = false;
+
+    // Температура, её CRC, влажность, её CRC.
+    uint8_t data[6];
+    const uint8_t count = Wire.requestFrom((uint8_t) HUMIDITY_ADDRESS, (uint8_t) sizeof(data));
+    for (uint8_t i = 0; i < count && i < sizeof(data); i++)
+        data[i] = Wire.read();
+    trace_humidity(count == sizeof(data) ? data : NULL);
+    if (count != sizeof(data) || sht_crc8(data, 2) != data[2] || sht_crc8(data + 3, 2) != data[5]) {
+        humidity_failed();
+        return true;
+    }
+
+    humidity_errors = 0;
+    chamber_rh = (uint32_t) ((data[3] << 8) | data[4]) * 10000UL / 65535;
+    humidity_valid = true;
+    return true;
+}
+
+// Шина I2C общая у дисплея и датчика влажности. За проход loop() она
+// отдаётся одному из них: датчику, если подошло время его транзакции,
+// иначе дисплею - под FRAME_SLOT_CHARS символов кадра. Так ни
+// перерисовка экрана, ни измерение влажности не задерживают опрос
+// энкодера и друг друга.
+void run_bus(void)
+{
+    if (poll_humidity())
+        return;
+    flush_frame(FRAME_SLOT_CHARS);
+}
+
+// Окончание сушки по влажности (см. HUMIDITY_SAMPLE_SEC). Вызывается раз
+// в период датчика температуры. Когда влажность вышла на плато ниже
+// dry_rh, оставшееся время обнуляется, и сушка заканчивается как по
+// времени.
+void track_humidity(void)
+{
+    if (!humidity_valid || filament->dry_rh == 0 || heating_stage != Working)
+        return;
+    // Счётчик секунд сброшен: началась новая сушка.
+    if (seconds < rh_sample_sec)
+        rh_count = 0;
+    if (rh_count > 0 && seconds - rh_sample_sec < HUMIDITY_SAMPLE_SEC)
+        return;
+
+    rh_sample_sec = seconds;
+    rh_samples[rh_next] = chamber_rh;
+    rh_next = (rh_next + 1) % HUMIDITY_PLATEAU_SAMPLES;
+    if (rh_count < HUMIDITY_PLATEAU_SAMPLES)
+        rh_count++;
+    if (rh_count < HUMIDITY_PLATEAU_SAMPLES || seconds < HUMIDITY_MIN_SEC)
+        return;
+
+    uint16_t low = rh_samples[0];
+    uint16_t high = rh_samples[0];
+    for (uint8_t i = 1; i < HUMIDITY_PLATEAU_SAMPLES; i++) {
+        if (rh_samples[i] < low)
+            low = rh_samples[i];
+        if (rh_samples[i] > high)
+            high = rh_samples[i];
+    }
+    if (high - low <= HUMIDITY_PLATEAU_BAND && chamber_rh < filament->dry_rh * 100U && target_time_sec > seconds)
+        target_time_sec = seconds;
 }
 
 // Показывает на дисплее температуру и время сушки
@@ -234,59 +1216,317 @@ void present_filament(void)
 {
     screen.setCursor(0, 0);
     screen.print(filament->name);
-    screen.print(" ?   ");
+    screen.print(F(" ?   "));
 
     screen.setCursor(0, 1);
     screen.print(filament->time_sec / 3600);
-    screen.print(" hours at ");
+    screen.print(F(" hours at "));
     screen.print(filament->temp);
-    screen.print("*      ");
+    screen.print(F("*      "));
+}
+
+// Построение таблицы распознавания по текущим уровням действий.
+// Окно каждого уровня - четверть расстояния до ближайшего соседнего
+// уровня (или до нуля): между окнами остаётся зазор, в котором
+// промежуточные значения при переключении контактов не распознаются.
+void build_input_table(void)
+{
+    memset(input_table, 0, sizeof(input_table));
+    for (uint8_t i = 0; i < 3; i++)
+        table_levels[i] = input_levels[i] >> 4;
+
+    for (uint8_t i = 0; i < 3; i++) {
+        const int level = table_levels[i];
+        int gap = level;
+        for (uint8_t j = 0; j < 3; j++)
+            if (j != i && abs(level - (int) table_levels[j]) < gap)
+                gap = abs(level - (int) table_levels[j]);
+        const int window = gap / 4;
+        const int first = constrain(level - window, 0, 1023) >> 2;
+        const int last = constrain(level + window, 0, 1023) >> 2;
+        for (int idx = first; idx <= last; idx++)
+            input_table[idx >> 2] |= (i + 1) << ((idx & 0x03) * 2);
+    }
+}
+
+// Загрузка калибровки входа из EEPROM. Если записи нет или она
+// испорчена, используются уровни для номиналов резисторов.
+void load_calibration(void)
+{
+    InputCalibration calibration;
+    EEPROM.get(CALIBRATION_ADDRESS, calibration);
+    const bool valid = calibration.magic == CALIBRATION_MAGIC
+        && OneWire::crc8((const uint8_t *) &calibration, offsetof(InputCalibration, crc)) == calibration.crc;
+
+    for (uint8_t i = 0; i < 3; i++)
+        input_levels[i] = (valid ? calibration.levels[i] : default_input_levels[i]) << 4;
+    build_input_table();
+}
+
+void save_calibration(const uint16_t levels[3])
+{
+    InputCalibration calibration;
+    memset(&calibration, 0, sizeof(calibration));
+    calibration.magic = CALIBRATION_MAGIC;
+    for (uint8_t i = 0; i < 3; i++)
+        calibration.levels[i] = levels[i];
+    calibration.crc = OneWire::crc8((const uint8_t *) &calibration, offsetof(InputCalibration, crc));
+    EEPROM.put(CALIBRATION_ADDRESS, calibration);
 }
 
-// Чтение действия энкодера/кнопок.
-// Выполняется до тех пор, пока не определит действие,
-// игнорируя случайные срабатывания.
-// Значения настраиваются эмпирическим путём.
-// Текущие значения указаны для номиналов резисторов согласно схеме,
-// при точности резисторов 1%.
+// Ждёт замыкания контакта и возвращает уровень АЦП первого установившегося
+// участка (среднее, если PLATEAU_SAMPLES отсчётов подряд отличаются от
+// первого не больше чем на PLATEAU_TOLERANCE), затем ждёт, пока контакты
+// разомкнутся. Жесты без установившегося участка пропускаются.
+uint16_t measure_level(void)
+{
+    uint16_t level = 0;
+    int first = 0;
+    uint32_t sum = 0;
+    uint16_t count = 0;
+    unsigned long idle_since = millis();
+
+    for (;;) {
+        const int value = analogRead(USER_INPUT_PIN);
+        const bool idle = value < INPUT_IDLE_LEVEL;
+
+        if (level == 0) {
+            if (!idle && count > 0 && abs(value - first) <= PLATEAU_TOLERANCE) {
+                sum += value;
+                count++;
+            } else {
+                if (count >= PLATEAU_SAMPLES)
+                    level = sum / count;
+                first = value;
+                sum = idle ? 0 : value;
+                count = idle ? 0 : 1;
+            }
+        }
+
+        if (!idle)
+            idle_since = millis();
+        else if (level != 0 && millis() - idle_since >= CALIBRATION_RELEASE_MS)
+            return level;
+        delay(1);
+    }
+}
+
+// Калибровка входа. Вызывается при включении с нажатой кнопкой:
+// нажатая кнопка даёт уровень ActionConfirm, затем пользователь
+// несколько раз крутит энкодер (нажимает кнопки) в каждую сторону.
+// При вращении первым замыкается контакт своего направления, поэтому
+// усредняется первый уровень каждого щелчка.
+void calibrate_input(void)
+{
+    uint16_t levels[3];
+
+    clear_screen();
+    screen.print(F("Calibration"));
+    screen.setCursor(0, 1);
+    screen.print(F("Release button"));
+    levels[ActionConfirm - 1] = measure_level();
+
+    for (uint8_t i = 0; i < 2; i++) {
+        const UserInputAction action = i == 0 ? ActionNext : ActionPrev;
+        screen.setCursor(0, 1);
+#ifdef USE_BUTTONS
+        screen.print(action == ActionNext ? F("Press > 4 times ") : F("Press < 4 times "));
+#else
+        screen.print(action == ActionNext ? F("Turn right x4   ") : F("Turn left x4    "));
+#endif
+        uint32_t sum = 0;
+        for (uint8_t n = 0; n < CALIBRATION_GESTURES; n++) {
+            sum += measure_level();
+            beep(20);
+        }
+        levels[action - 1] = sum / CALIBRATION_GESTURES;
+    }
+
+    bool valid = true;
+    for (uint8_t i = 0; i < 3; i++)
+        for (uint8_t j = i + 1; j < 3; j++)
+            if (abs((int) levels[i] - (int) levels[j]) < MIN_LEVEL_GAP)
+                valid = false;
+
+    screen.setCursor(0, 1);
+    if (valid) {
+        save_calibration(levels);
+        screen.print(F("Saved           "));
+    } else {
+        screen.print(F("Failed          "));
+    }
+    beep(250);
+    delay(1000);
+
+    load_calibration();
+}
+
+// Выбор дополнительных датчиков, если на шине их несколько: для
+// каждой роли (нагреватель, комната) на экране по очереди номера
+// датчиков с их температурами и вариант "None", нажатие отмечает
+// выбранный датчик меткой роли в его EEPROM. Узнать датчик можно,
+// нагрев его рукой.
+void mark_probes(void)
+{
+    static const int16_t marks[] = { HEATER_PROBE_MARK, AMBIENT_PROBE_MARK };
+    DeviceAddress addresses[MAX_PROBES];
+    int16_t temps[MAX_PROBES] = { 0 };
+    uint8_t count = 0;
+
+    while (count < MAX_PROBES && sensor.getAddress(addresses[count], count))
+        count++;
+    if (count < 2)
+        return;
+
+    for (uint8_t role = 0; role < 2; role++) {
+        uint8_t choice = 0;
+        UserInputAction action = NoAction;
+
+        clear_screen();
+        screen.print(role == 0 ? F("Heater probe?") : F("Ambient probe?"));
+        start_conversion();
+        while (action != ActionConfirm) {
+            action = poll_action();
+            bool redraw = action == ActionNext || action == ActionPrev;
+            // Варианты: датчики 0..count-1 и count - "None".
+            if (action == ActionNext)
+                choice = choice == count ? 0 : choice + 1;
+            else if (action == ActionPrev)
+                choice = choice == 0 ? count : choice - 1;
+            if (millis() - conversion_start >= conversion_ms) {
+                for (uint8_t i = 0; i < count; i++) {
+                    int16_t raw = 0;
+                    query_probe(addresses[i], &raw);
+                    temps[i] = raw >> 7;
+                }
+                start_conversion();
+                redraw = true;
+            }
+            if (redraw) {
+                screen.setCursor(0, 1);
+                if (choice == count) {
+                    screen.print(F("None"));
+                } else {
+                    screen.print(F("Probe "));
+                    screen.print(choice + 1);
+                    screen.print(F(": "));
+                    screen.print(temps[choice]);
+                    screen.print('*');
+                }
+                screen.print(F("        "));
+            }
+            delay(1);
+        }
+
+        for (uint8_t i = 0; i < count; i++)
+            update_probe_mark(addresses[i], marks[role], i == choice);
+        beep(250);
+    }
+}
+
+// Медленное слежение за уровнем распознанного действия (напряжение
+// питания и сопротивления плывут с температурой). Таблица
+// перестраивается, когда уровень сместился на её шаг.
+void track_input_level(const UserInputAction action, const int value)
+{
+    const uint8_t i = action - 1;
+    input_levels[i] += ((int16_t) (value << 4) - (int16_t) input_levels[i]) >> DRIFT_SHIFT;
+    if (abs((int) (input_levels[i] >> 4) - (int) table_levels[i]) >= 4)
+        build_input_table();
+}
+
+// Чтение действия энкодера/кнопок: значение АЦП распознаётся по таблице
+// input_table за одно обращение, без цепочки сравнений.
 UserInputAction read_action(void)
 {
-    int value = analogRead(USER_INPUT_PIN);
-    if (value > 840 && value < 850)
-        return ActionPrev;
-    if (value > 690 && value < 705)
-        return ActionNext;
-    if (value > 560 && value < 610)
-        return ActionConfirm;
-    return NoAction;
+    const int value = analogRead(USER_INPUT_PIN);
+    const uint8_t idx = value >> 2;
+    const UserInputAction action = (UserInputAction) ((input_table[idx >> 2] >> ((idx & 0x03) * 2)) & 0x03);
+    if (action != NoAction)
+        track_input_level(action, value);
+    trace_adc(value, action);
+    return action;
 }
 
 #ifdef USE_BUTTONS
-UserInputAction process_buttons()
+// Кнопка, которая сейчас нажата, и с какого момента.
+UserInputAction button_pressed = NoAction;
+unsigned long button_time_begin = 0;
+// О нажатии уже сообщили (короткое для Next/Prev или длинное для Confirm).
+bool button_reported = false;
+
+// Разбор нажатий кнопок. Не ждёт: вызывается постоянно, действие
+// возвращает, когда нажатие распознано, иначе NoAction.
+// Next/Prev срабатывают, когда кнопка удерживается дольше времени
+// дребезга, Confirm - при отпускании (короткое нажатие) или по истечении
+// LONG_PRESS_MS удержания (длинное).
+UserInputAction poll_buttons(void)
 {
-    UserInputAction action = read_action();
-    if (action == NoAction)
+    const UserInputAction action = read_action();
+    const unsigned long now = millis();
+    const unsigned long held = now - button_time_begin;
+
+    if (action != button_pressed) {
+        const bool short_press = button_pressed == ActionConfirm && !button_reported && held >= BUTTONS_JITTER;
+        button_pressed = action;
+        button_time_begin = now;
+        button_reported = false;
+        return short_press ? ActionConfirm : NoAction;
+    }
+
+    if (action == NoAction || button_reported)
+        return NoAction;
+
+    if (action == ActionConfirm) {
+        if (held < LONG_PRESS_MS)
+            return NoAction;
+        button_reported = true;
+        return ActionLongPress;
+    }
+
+    if (held < BUTTONS_JITTER)
         return NoAction;
-    // Выдерживаем паузу на дребезг.
-    // Если после этого значение не изменилось, считаем что кнопка нажата.
-    delay(BUTTONS_JITTER);
-    if (read_action() != action)
-        action = NoAction;
+    button_reported = true;
     return action;
 }
 #else
-UserInputAction process_encoder()
+// Состояние разбора сигналов энкодера.
+enum EncoderState
 {
-    const UserInputAction action = read_action();
+    EncoderIdle, // Контакты разомкнуты.
+    EncoderSecondContact, // Замкнулся первый контакт, ждём второй.
+    EncoderRelease, // Ждём размыкания контактов/отпускания кнопки.
+};
 
-    // Если энкодер бездействует, то сразу же выходим.
-    if (action == NoAction)
-        return NoAction;
+EncoderState encoder_state = EncoderIdle;
+// Первое распознанное действие текущего жеста.
+UserInputAction encoder_action = NoAction;
+// Момент замыкания первого контакта.
+unsigned long encoder_time_begin = 0;
+// Момент, с которого контакты разомкнуты.
+unsigned long encoder_time_release = 0;
+// Направление и начало предыдущего щелчка - для оценки скорости вращения.
+UserInputAction encoder_last_turn = NoAction;
+unsigned long encoder_last_begin = 0;
+
+// Скорость вращения по интервалу между началами двух щелчков в одну
+// сторону. Смена направления сбрасывает скорость.
+InputSpeed encoder_speed(const UserInputAction action, const unsigned long begin)
+{
+    const unsigned long interval = begin - encoder_last_begin;
+    const bool same_direction = action == encoder_last_turn;
 
-    unsigned long time_diff = 0;
-    unsigned long time_begin = millis();
+    encoder_last_turn = action;
+    encoder_last_begin = begin;
 
-    /*
+    if (!same_direction || interval >= ENCODER_MEDIUM_MS)
+        return SpeedSlow;
+    if (interval >= ENCODER_FAST_MS)
+        return SpeedMedium;
+    return SpeedFast;
+}
+
+/*
     Алгоритм обработки вращения энкодера и подавления дребезга контактов.
     Основан на механике работы энкодера. При вращении в любую сторону сначала
     замыкается один контакт, затем пока он замкнут замыкается другой контакт.
@@ -301,79 +1541,257 @@ UserInputAction process_encoder()
     ограничиваем ожидание таймаутом.
     При вращении в другую сторону всё точно также, только порядок замыкания
     контактов меняется местами.
-  */
 
-    if (action == ActionPrev) {
-        for (;;) {
-            if (read_action() == ActionNext)
-                break;
-            delay(1);
-            if (millis() - time_begin > ENCODER_TIMEOUT)
-                break;
-        }
-    }
+    Щелчок засчитывается, когда контакты разомкнуты дольше ENCODER_RELEASE:
+    дребезг на размыкании не даёт ложных щелчков, а паузы после щелчка
+    не нужно, поэтому быстрое вращение не теряет шагов.
 
-    if (action == ActionNext) {
-        for (;;) {
-            if (read_action() == ActionPrev)
-                break;
-            delay(1);
-            if (millis() - time_begin > ENCODER_TIMEOUT)
-                break;
+    Функция ничего не ждёт: она вызывается постоянно, продвигает автомат
+    состояний на шаг и возвращает действие, когда жест закончился, иначе
+    NoAction. Так опрос энкодера не останавливает опрос термодатчика
+    и управление нагревателем.
+*/
+UserInputAction poll_encoder(void)
+{
+    const unsigned long now = millis();
+
+    switch (encoder_state) {
+        case EncoderIdle:
+            // Пока на ADC ничего не происходило, АЦП не опрашиваем.
+            if (!input_event_occurred)
+                return NoAction;
+            noInterrupts();
+            input_event_occurred = false;
+            interrupts();
+            encoder_action = read_action();
+            if (encoder_action == NoAction)
+                return NoAction;
+            encoder_time_begin = now;
+            encoder_time_release = now;
+            encoder_state = encoder_action == ActionConfirm ? EncoderRelease : EncoderSecondContact;
+            return NoAction;
+
+        case EncoderSecondContact: {
+            const UserInputAction second = encoder_action == ActionNext ? ActionPrev : ActionNext;
+            const UserInputAction action = read_action();
+            if (action == second || now - encoder_time_begin > ENCODER_TIMEOUT) {
+                encoder_state = EncoderRelease;
+            } else if (action != NoAction) {
+                encoder_time_release = now;
+            } else if (now - encoder_time_release >= ENCODER_RELEASE) {
+                // Первый контакт разомкнулся, а второй так и не замкнулся:
+                // энкодер не докрутили до следующего положения.
+                encoder_state = EncoderIdle;
+            }
+            return NoAction;
         }
-    }
 
-    /*
-    Когда при вращении оба контакта отработали, напряжение возвращается
-    в ноль (действие NoAction). Дожидаемся этого. Если нажимали кнопку,
-    то ждём пока её отпустят.
-  */
-    while (read_action() != NoAction)
-        delay(1);
+        case EncoderRelease:
+            /*
+            Когда при вращении оба контакта отработали, напряжение возвращается
+            в ноль (действие NoAction). Дожидаемся этого. Если нажимали кнопку,
+            то ждём пока её отпустят, а если её держат дольше LONG_PRESS_MS,
+            сразу сообщаем о длинном нажатии.
+          */
+            if (read_action() != NoAction) {
+                encoder_time_release = now;
+                if (encoder_action == ActionConfirm && now - encoder_time_begin >= LONG_PRESS_MS) {
+                    encoder_action = NoAction;
+                    return ActionLongPress;
+                }
+                return NoAction;
+            }
+            if (now - encoder_time_release < ENCODER_RELEASE)
+                return NoAction;
+
+            encoder_state = EncoderIdle;
+            if (encoder_action == ActionNext || encoder_action == ActionPrev)
+                input_speed = encoder_speed(encoder_action, encoder_time_begin);
+            return encoder_action;
+    }
 
-    /*
-    Если нажимали кнопку, тогда спим в пределах погрешности энкодера
-    (приблизительного времени, в течение которого контакты дребезжат).
-    Если энкодер крутили, тогда спим в два раза большее время, чем заняла
-    длительность импульса, начавшегося с замыкания одного контакта и
-    закончившаяся с размыканием любого из контактов. Это с достаточно
-    высокой вероятностью гарантирует, что контакты отработали и даёт
-    защиту от ложных срабатываний при слишком быстром вращении энкодера.
-  */
-    if (action == ActionConfirm)
-        time_diff = 0;
-    else
-        time_diff = millis() - time_begin;
-    delay(time_diff * 2 + ENCODER_JITTER);
+    return NoAction;
 }
 #endif // USE_BUTTONS
 
-// Дожидается любого действия от энкодера/кнопок и возвращает его.
-UserInputAction wait_for_action(void)
+// Опрос энкодера/кнопок без ожидания.
+UserInputAction poll_action(void)
 {
-    // Ждём пока на ADC произойдёт какое-либо действие.
-    while (!input_event_occurred)
-        delay(1);
-
-    const UserInputAction action =
 #ifdef USE_BUTTONS
-        process_buttons();
+    return poll_buttons();
 #else
-        process_encoder();
+    return poll_encoder();
 #endif
+}
 
-    // Сбрасываем флаг, показывающий что от ADC приходили события.
-    // Это нужно для подавления дребезга контактов, событий могло прийти
-    // множество, но одно мы уже обработали. Остальные будут обработаны
-    // позже.
-    noInterrupts();
-    input_event_occurred = false;
-    interrupts();
+// Распознавание жестов поверх действий poll_action() по их моментам
+// во времени millis(). Ничего не ждёт.
+// Короткое нажатие откладывается на GESTURE_MS: если за это время
+// нажали ещё раз, это двойной щелчок, если начали вращать - вращение
+// "с нажатой кнопкой". Настоящее вращение с удержанной кнопкой на общем
+// делителе не различить - замкнутая кнопка маскирует контакты энкодера,
+// поэтому вместо него - нажатие и вращение сразу после него. Режим
+// держится, пока щелчки идут чаще, чем через GESTURE_MS.
+UserInputAction poll_gesture(void)
+{
+    const UserInputAction action = poll_action();
+    const unsigned long now = millis();
+
+    switch (action) {
+        case NoAction:
+            if (gesture_click && now - gesture_time >= GESTURE_MS) {
+                gesture_click = false;
+                return ActionConfirm;
+            }
+            return NoAction;
+
+        case ActionConfirm:
+            gesture_shift = false;
+            if (gesture_click) {
+                gesture_click = false;
+                return ActionDoubleClick;
+            }
+            gesture_click = true;
+            gesture_time = now;
+            return NoAction;
+
+        case ActionNext:
+        case ActionPrev:
+            if (gesture_click || (gesture_shift && now - gesture_time < GESTURE_MS)) {
+                gesture_click = false;
+                gesture_shift = true;
+                gesture_time = now;
+                return action == ActionNext ? ActionShiftNext : ActionShiftPrev;
+            }
+            gesture_shift = false;
+            return action;
+
+        default:
+            gesture_click = false;
+            gesture_shift = false;
+            return action;
+    }
+}
 
-    return action;
+// Дожидается любого жеста энкодера/кнопок и возвращает его.
+UserInputAction wait_for_action(void)
+{
+    for (;;) {
+        const UserInputAction action = poll_gesture();
+        if (action != NoAction)
+            return action;
+        delay(1);
+    }
+}
+
+// Буква причины сброса для журнала: P - подача питания, E - вывод RESET,
+// B - просадка питания, W - сторожевой таймер, ? - неизвестно.
+char reset_letter(const uint8_t cause)
+{
+    if (cause & (1 << WDRF))
+        return 'W';
+    if (cause & (1 << BORF))
+        return 'B';
+    if (cause & (1 << EXTRF))
+        return 'E';
+    if (cause & (1 << PORF))
+        return 'P';
+    return '?';
+}
+
+// Вывод журнала отказов и сохранённого кольца событий в Serial, от
+// свежих записей к старым. Строки начинаются с '#', как комментарии
+// трассы, чтобы не мешать её разбору.
+void dump_fault_log(void)
+{
+    FaultRecord record;
+
+    Serial.println(F("# fault log: age code stage minutes sensor estimate target reset"));
+    for (uint8_t age = 0; read_fault(age, &record); age++) {
+        Serial.print(F("# fault "));
+        Serial.print(age);
+        Serial.print(' ');
+        Serial.print(record.code);
+        Serial.print(' ');
+        Serial.print(record.stage);
+        Serial.print(' ');
+        Serial.print(record.minutes);
+        Serial.print(' ');
+        Serial.print(record.sensor);
+        Serial.print(' ');
+        Serial.print(record.estimate);
+        Serial.print(' ');
+        Serial.print(record.target);
+        Serial.print(' ');
+        Serial.println(record.reset_cause, HEX);
+    }
+
+    // Кольцо событий - байтами, для разбора на хосте: program --postmortem.
+    PostMortem postmortem;
+    if (!read_postmortem(&postmortem))
+        return;
+    Serial.print(F("# postmortem "));
+    const uint8_t *const bytes = (const uint8_t *) &postmortem;
+    for (uint8_t i = 0; i <= offsetof(PostMortem, crc); i++) {
+        if (bytes[i] < 0x10)
+            Serial.print('0');
+        Serial.print(bytes[i], HEX);
+    }
+    Serial.println();
+}
+
+// Экран диагностики: журнал отказов, от свежих записей к старым.
+// В первой строке причина, во второй - номер записи, стадия (I, P, W),
+// сколько минут она шла, температура датчика и причина сброса (см.
+// reset_letter()). Вращение листает записи, нажатие - выход, длинное
+// нажатие очищает журнал. При входе журнал выводится в Serial.
+void show_fault_log(void)
+{
+    static const char stage_letters[] = { 'I', 'P', 'W' };
+    uint8_t age = 0;
+    UserInputAction action = NoAction;
+
+    dump_fault_log();
+    for (;;) {
+        FaultRecord record;
+        const bool found = read_fault(age, &record);
+        clear_screen();
+        if (!found) {
+            screen.print(F("No faults"));
+        } else {
+            if (record.code == NoPanic)
+                screen.print(F("Reset"));
+            else
+                screen.print(panic_message(record.code));
+            screen.setCursor(0, 1);
+            screen.print(age + 1);
+            screen.print(' ');
+            screen.print(stage_letters[record.stage % 3]);
+            screen.print(' ');
+            screen.print(record.minutes);
+            screen.print(F("m "));
+            screen.print(record.sensor >> 7);
+            screen.print(F("* "));
+            screen.print(reset_letter(record.reset_cause));
+        }
+
+        action = wait_for_action();
+        if (action == ActionLongPress) {
+            clear_fault_log();
+            beep(100);
+            return;
+        }
+        if (action == ActionConfirm || action == ActionDoubleClick)
+            return;
+        if ((action == ActionNext || action == ActionShiftNext) && found && read_fault(age + 1, &record))
+            age++;
+        if ((action == ActionPrev || action == ActionShiftPrev) && age > 0)
+            age--;
+    }
 }
 
-// Цикл отображения меню выбора пластика.
+// Цикл отображения меню выбора пластика. Длинное нажатие открывает
+// журнал отказов.
 void choose_filament(void)
 {
     clear_screen();
@@ -384,16 +1802,20 @@ void choose_filament(void)
 
     for (;;) {
         UserInputAction action = wait_for_action();
-        if (action == ActionConfirm)
+        if (action == ActionConfirm || action == ActionDoubleClick)
             return;
-        if (action == ActionNext) {
+        if (action == ActionLongPress) {
+            show_fault_log();
+            clear_screen();
+        }
+        if (action == ActionNext || action == ActionShiftNext) {
             // Если добрались до конца таблицы, переходим в её начало.
             if (cur_idx == MAX_IDX)
                 cur_idx = 0;
             else
                 cur_idx++;
         }
-        if (action == ActionPrev) {
+        if (action == ActionPrev || action == ActionShiftPrev) {
             // Если добрались до начала таблицы, переходим в её конец.
             if (cur_idx == MIN_IDX)
                 cur_idx = MAX_IDX;
@@ -405,92 +1827,425 @@ void choose_filament(void)
     }
 }
 
+// Коэффициенты регулятора для уставки temp: линейная интерполяция
+// между соседними точками gain_schedule, за её краями - крайние точки.
+GainPoint scheduled_gains(const uint8_t temp)
+{
+    uint8_t i = 1;
+    while (i < gain_points - 1 && gain_schedule[i].temp < temp)
+        i++;
+    const GainPoint &low = gain_schedule[i - 1];
+    const GainPoint &high = gain_schedule[i];
+    const uint8_t span = high.temp - low.temp;
+    const uint8_t pos = constrain(temp, low.temp, high.temp) - low.temp;
+
+    GainPoint gains;
+    gains.temp = temp;
+    gains.preheat_kp = low.preheat_kp + ((int16_t) high.preheat_kp - low.preheat_kp) * pos / span;
+    gains.hold_kp = low.hold_kp + ((int16_t) high.hold_kp - low.hold_kp) * pos / span;
+    gains.hold_ki = low.hold_ki + ((int16_t) high.hold_ki - low.hold_ki) * pos / span;
+    gains.bias = low.bias + ((int16_t) high.bias - low.bias) * pos / span;
+    return gains;
+}
+
+// ПИ-регулятор по оценке температуры камеры с коэффициентами из
+// расписания по уставке и стадии. Интеграл начинается с мощности
+// удержания из расписания и не копится, пока мощность упирается в
+// пределы, так что прогрев идёт на полной мощности и тормозит перед
+// уставкой П-частью. С датчиком в комнате постоянную часть мощности
+// даёт упреждение по разнице уставки и комнаты, интеграл начинается с
+// нуля и добирает только то, чего модель потерь не учла, так что
+// изменение температуры в комнате отрабатывается сразу, а не через
+// интеграл. Мощность превращается во включения нагревателя
+// накопителем: за N периодов нагреватель включён N * мощность / DUTY_ONE
+// раз, реле переключается не чаще раза в период.
+bool control_heater(void)
+{
+    const GainPoint gains = scheduled_gains(target_temp);
+    const int16_t error = TEMP_RAW(target_temp) - (observer_chamber >> OBSERVER_SHIFT);
+    const uint8_t kp = heating_stage == Working ? gains.hold_kp : gains.preheat_kp;
+
+    if (!control_started) {
+        control_integral = ambient_probe ? 0 : (int32_t) gains.bias << 8;
+        duty_accumulator = 0;
+        control_started = true;
+    }
+
+    int32_t feedforward = 0;
+    if (ambient_probe)
+        feedforward = (int32_t) (TEMP_RAW(target_temp) - ambient_raw) * FEEDFORWARD_GAIN >> 15;
+    const int32_t proportional = (int32_t) error * kp >> 7;
+    const int32_t integral = control_integral + ((int32_t) error * gains.hold_ki >> 7);
+    int32_t duty = proportional + feedforward + (integral >> 8);
+    if (duty >= 0 && duty <= DUTY_ONE)
+        control_integral = integral;
+    duty = constrain(proportional + feedforward + (control_integral >> 8), 0, DUTY_ONE);
+
+    duty_accumulator += duty;
+    if (duty_accumulator < DUTY_ONE)
+        return false;
+    duty_accumulator -= DUTY_ONE;
+    return true;
+}
+
 // Включаем/выключаем нагреватель и переключаем стадию сушки.
 void set_heater_state(const uint8_t temp)
 {
-    if (filament == NULL)
-        panic("Heater state.");
+    if (filament == NULL) {
+        panic(PanicHeaterState);
+        return;
+    }
+
+    if (temp >= target_temp && heating_stage != Working) {
+        // Когда камера прогрета до уставки, включается основной рабочий
+        // режим просушки. Сбрасываем счётчик времени, чтобы начать
+        // обратный отсчёт. Если сушилка была в состоянии бездействия, но
+        // температура уже не ниже нужной, значит пластик начали сушить не
+        // дождавшись пока она остынет. Тоже переключаемся в основной режим.
+        heating_stage = Working;
+        record_event(EventStage, Working);
+        reset_timer();
+    } else if (heating_stage == Idle) {
+        // Если сушилка бездействовала, значит с первого раза, когда нужен
+        // нагрев, начинаем прогрев. Сбрасываем счётчик времени, чтобы
+        // показать, сколько уже идёт прогрев.
+        heating_stage = PreHeating;
+        record_event(EventStage, PreHeating);
+        reset_timer();
+    }
 
-    if (temp > filament->temp) {
+    // Мощность задаёт регулятор камеры (расписание коэффициентов,
+    // упреждение по комнате). С датчиком на нагревателе её ограничивает
+    // каскад (update_cascade()): поверхность не греется выше уставки
+    // внутреннего контура.
+    bool on = control_heater();
+    if (heater_probe && heater_raw >= heater_setpoint)
+        on = false;
+
+    if (on)
+        turn_on();
+    else
         turn_off();
-        // Если сушилка была в состоянии прогрева, значит с первого выключения
-        // нагревателя включается основной рабочий режим просушки. Сбрасываем
-        // счётчик времени, чтобы начать обратный отсчёт.
-        // Если сушилка была в состоянии бездействия, но температура уже выше
-        // нужной, значит плаcтик начали сушить не дождавшись пока она остынет.
-        // Тоже переключаемся в основной режим.
-        if (heating_stage == Idle || heating_stage == PreHeating) {
-            heating_stage = Working;
-            reset_timer();
+}
+
+// Изменение настроек сушки энкодером: вращение во время сушки меняет
+// оставшееся время, во время прогрева - температуру. Вращение после
+// нажатия всегда меняет температуру.
+void adjust_target(const UserInputAction action)
+{
+    const bool next = action == ActionNext || action == ActionShiftNext;
+
+    if (heating_stage == Working && (action == ActionNext || action == ActionPrev)) {
+        const unsigned long step = time_steps[input_speed];
+        if (next) {
+            target_time_sec = constrain(target_time_sec + step, 0UL, MAX_TIME_SEC);
+        } else {
+            // Оставшееся время не может стать меньше нуля: если шаг больше
+            // оставшегося, сушка закончится на следующей секунде.
+            if (target_time_sec >= seconds + step)
+                target_time_sec -= step;
+            else
+                target_time_sec = seconds;
         }
     } else {
-        turn_on();
-        if (heating_stage == Idle) {
-            // Если сушилка бездействовала, значит с первого включения нагревателя
-            // начинаем прогрев. Сбрасываем счётчик времени, чтобы показать, сколько
-            // уже идёт прогрев.
-            heating_stage = PreHeating;
-            reset_timer();
-        }
+        const uint8_t step = temp_steps[input_speed];
+        if (next)
+            target_temp = constrain(target_temp + step, MIN_TEMP, MAX_TEMP);
+        else
+            target_temp = constrain(target_temp - step, MIN_TEMP, MAX_TEMP);
     }
 }
 
+// Прерывание сушки: выключаем нагрев и возвращаемся в меню выбора.
+void abort_drying(void)
+{
+    turn_off();
+    paused = false;
+    heating_stage = Idle;
+    record_event(EventStage, Idle);
+    filament = NULL;
+    beep(100);
+}
+
+// Включение/выключение подсветки дисплея.
+void set_backlight(const bool on)
+{
+    backlight_on = on;
+    if (on)
+        screen.backlight();
+    else
+        screen.noBacklight();
+}
+
+// Обработка жестов энкодера/кнопок во время прогрева и сушки.
+// Вращение меняет настройки, короткое нажатие ставит сушку на паузу
+// или снимает с неё, длинное - прерывает сушку, двойной щелчок
+// выключает и включает подсветку дисплея.
+void process_action(const UserInputAction action)
+{
+    switch (action) {
+        case NoAction:
+            return;
+        case ActionNext:
+        case ActionPrev:
+        case ActionShiftNext:
+        case ActionShiftPrev:
+            adjust_target(action);
+            break;
+        case ActionDoubleClick:
+            set_backlight(!backlight_on);
+            break;
+        case ActionConfirm:
+            paused = !paused;
+            // Нагрев выключаем сразу, не дожидаясь следующего замера.
+            if (paused)
+                turn_off();
+            break;
+        case ActionLongPress:
+            abort_drying();
+            return;
+    }
+    last_input_time = millis();
+    refresh_screen = true;
+}
+
 // Обновление данных на дисплее.
 void update_screen(const uint8_t temp)
 {
-    screen.setCursor(0, 0);
-    screen.print(filament->name);
-    screen.print(" ");
-    screen.print(filament->temp);
-    screen.print(" / ");
-    screen.print(temp);
-    screen.print("* ");
+    frame.setCursor(0, 0);
+    frame.print(filament->name);
+    frame.print(' ');
+    frame.print(target_temp);
+    frame.print(F(" / "));
+    frame.print(temp);
+    frame.print(F("* "));
     // Если нагреватель включен, рисуем в конце первой строки букву 'H'.
     if (heater_is_on)
-        screen.print("H");
+        frame.print('H');
     // Добавляем в конец несколько пробелов чтобы гарантированно корректно
     // отрисовать всю строку и в ней не осталось "призраков" от предыдущих
     // символов, если прежняя строка была короче по длине.
-    screen.print("      ");
+    frame.print(F("      "));
 
-    screen.setCursor(0, 1);
+    frame.setCursor(0, 1);
 
     unsigned long time_val = 0;
 
     // Если сушилка находится в стадии сушки, отображаем
     // сколько времени осталось до окончания.
     if (heating_stage == Working) {
-        screen.print("ETA ");
-        time_val = filament->time_sec - seconds;
+        frame.print(paused ? F("Paused ") : F("ETA "));
+        time_val = target_time_sec - seconds;
         const uint8_t hours = (time_val / 3600) & 0xFF;
         if (hours < 10)
-            screen.print("0");
-        screen.print(hours);
-        screen.print(":");
+            frame.print('0');
+        frame.print(hours);
+        frame.print(':');
     } else {
         // Если сушилка находится в состоянии прогрева, тогда
         // показываем, сколько времени прошло с момента его
         // начала.
-        screen.print("Preheating ");
+        frame.print(paused ? F("Paused ") : F("Preheating "));
         time_val = seconds;
-        // Если в течение часа так и не удалось прогреть сушилку
-        // до заданной температуры, значит что-то точно идёт не так.
-        if (time_val >= 3600)
-            panic("Preheating.");
     }
 
     const uint8_t mins = ((time_val % 3600) / 60) & 0xFF;
     if (mins < 10)
-        screen.print("0");
-    screen.print(mins);
-    screen.print(":");
+        frame.print('0');
+    frame.print(mins);
+    frame.print(':');
 
     const uint8_t secs = (time_val % 60) & 0xFF;
     if (secs < 10)
-        screen.print("0");
-    screen.print(secs);
+        frame.print('0');
+    frame.print(secs);
+
+    // Влажность в камере, если её есть куда вывести.
+    if (heating_stage == Working && !paused && humidity_valid) {
+        frame.print(' ');
+        frame.print(chamber_rh / 100);
+        frame.print('%');
+    }
+
+    frame.print(F("      "));
+}
+
+// Устранена ли причина паники: датчик снова отвечает и показывает
+// температуру в допустимых пределах. Пробой реле и нагреватель, не
+// давший роста температуры на самопроверке, не снимаются до выключения
+// питания: отсекающее реле уже разомкнуто, а повторная попытка начала
+// бы сушку с неисправным нагревом.
+bool panic_cleared(void)
+{
+    switch (panic_code) {
+        case PanicSensorLost:
+        case PanicFrozen:
+        case PanicBurned:
+            return current_temp != 0;
+        case PanicHeaterStuck:
+        case PanicNoHeat:
+            return false;
+        default:
+            return true;
+    }
+}
 
-    screen.print("      ");
+// Вторая строка экрана паники: температура и что можно сделать.
+void show_panic_status(void)
+{
+    screen.setCursor(0, 1);
+    if (current_temp != 0)
+        screen.print(current_temp);
+    else
+        screen.print(F("--"));
+    screen.print(F("*C "));
+    if (panic_code == PanicHeaterStuck || panic_code == PanicNoHeat)
+        screen.print(F("Power off"));
+    else if (panic_cleared())
+        screen.print(F("Hold=retry"));
+    else
+        screen.print(F("Wait"));
+    screen.print(F("          "));
+}
+
+// Один шаг loop() в состоянии паники. Нагрев запрещён, температура
+// читается каждый период и показывается вместе с тем, устранена ли
+// причина. Короткое нажатие глушит сигнал, длинное, если причина
+// устранена, снимает панику: сушилка возвращается в меню выбора
+// пластика, отсекающее реле замкнётся с началом следующей сушки.
+void handle_panic(void)
+{
+    turn_off();
+    play_alarm();
+
+    if (millis() - conversion_start >= conversion_ms) {
+        current_temp = query_sensor();
+        start_conversion();
+        set_backlight(true);
+        show_panic_status();
+    }
+
+    const UserInputAction action = poll_gesture();
+    if (action == ActionConfirm) {
+        alarm_muted = true;
+        digitalWrite(BEEPER_PIN, LOW);
+    } else if (action == ActionLongPress && panic_cleared()) {
+        digitalWrite(BEEPER_PIN, LOW);
+        panic_code = NoPanic;
+        panic_reason = NULL;
+        filament = NULL;
+    }
+
+    delay(1);
+}
+
+// Самопроверка при включении. Первое преобразование запускается до
+// инициализации дисплея и идёт во время её задержек. Его показание
+// проверяется на присутствие датчика, CRC и диапазон, затем включается
+// нагрев. Следующее показание проверяет стабильность: за одно
+// преобразование нагрев до датчика ещё не доходит. Дальше показания
+// читаются каждое преобразование, пока датчик на нагревателе (или, без
+// него, датчик камеры) не покажет рост. Возвращает биты SelfTestFailure.
+uint8_t self_test(void)
+{
+    uint8_t failures = 0;
+
+    // Дисплей только принимает данные: проверяется, что он отвечает на
+    // свой адрес.
+    Wire.beginTransmission(LCD_ADDRESS);
+    if (Wire.endTransmission() != 0)
+        failures |= SelfTestDisplay;
+    // Датчик влажности необязателен: если он ответил, сушка может
+    // закончиться по влажности.
+    Wire.beginTransmission(HUMIDITY_ADDRESS);
+    humidity_sensor = Wire.endTransmission() == 0;
+
+    int16_t first = 0;
+    wait_conversion();
+    if (!sensor_found || !query_probe(sensor_address, &first) || first < TEMP_RAW(2) || first >= TEMP_RAW(120))
+        return failures | SelfTestSensor;
+    int16_t base = first;
+    if (heater_probe && !query_probe(heater_address, &base)) {
+        heater_probe = false;
+        record_event(EventSensorError, SensorAuxLost);
+        base = first;
+    }
+    int16_t rise = heater_probe ? POST_HEATER_RISE : POST_CHAMBER_RISE;
+    start_conversion();
+    current_temp = first >> 7;
+
+    const unsigned long start = millis();
+    bool stable_checked = false;
+    bool heated = false;
+    close_cutoff();
+    turn_on();
+    while (!heated && millis() - start < POST_HEATER_WINDOW_MS) {
+        if (millis() - start >= POST_HEATER_PULSE_MS) {
+            turn_off();
+            cut_off();
+        }
+        wait_conversion();
+        int16_t chamber = 0;
+        if (!query_probe(sensor_address, &chamber)) {
+            failures |= SelfTestSensor;
+            break;
+        }
+        if (!stable_checked && abs(chamber - first) > POST_STABLE_STEP) {
+            failures |= SelfTestUnstable;
+            break;
+        }
+        stable_checked = true;
+        // Датчик на нагревателе пропал - это не отказ нагревателя: рост
+        // дальше ищется по датчику камеры, как без датчика на нагревателе.
+        int16_t raw = chamber;
+        if (heater_probe && !query_probe(heater_address, &raw)) {
+            heater_probe = false;
+            record_event(EventSensorError, SensorAuxLost);
+            base = first;
+            rise = POST_CHAMBER_RISE;
+            raw = chamber;
+        }
+        start_conversion();
+        heated = raw - base >= rise;
+    }
+    turn_off();
+    cut_off();
+    start_conversion();
+
+    if (!heated && !(failures & (SelfTestSensor | SelfTestUnstable)))
+        failures |= SelfTestHeater;
+    return failures;
+}
+
+// Итог самопроверки: на дисплее ("ok", "NO" - неисправен, "??" -
+// показания нестабильны, "--" - не проверялся) и строкой комментария в
+// Serial, которая видна и без дисплея.
+void show_self_test(const uint8_t failures)
+{
+    const __FlashStringHelper *sensor_state = F("ok");
+    const __FlashStringHelper *heater_state = F("ok");
+    if (failures & (SelfTestSensor | SelfTestUnstable)) {
+        sensor_state = failures & SelfTestSensor ? F("NO") : F("??");
+        heater_state = F("--");
+    } else if (failures & SelfTestHeater) {
+        heater_state = F("NO");
+    }
+
+    screen.setCursor(0, 1);
+    screen.print(F("Sens "));
+    screen.print(sensor_state);
+    screen.print(F(" Heat "));
+    screen.print(heater_state);
+
+    Serial.print(F("# self-test sensor "));
+    Serial.print(sensor_state);
+    Serial.print(F(" heater "));
+    Serial.print(heater_state);
+    Serial.print(F(" display "));
+    Serial.print(failures & SelfTestDisplay ? F("NO") : F("ok"));
+    Serial.print(F(" humidity "));
+    Serial.println(humidity_sensor ? F("ok") : F("--"));
+    delay(POST_SHOW_MS);
 }
 
 void setup()
@@ -498,19 +2253,50 @@ void setup()
     // Настраиваем пины на выход.
     pinMode(BEEPER_PIN, OUTPUT);
     pinMode(HEATER_PIN, OUTPUT);
+    pinMode(CUTOFF_PIN, OUTPUT);
+
+    Serial.begin(SERIAL_BAUD_RATE);
+#ifdef TRACE_RECORDER
+    Serial.println(F("# thermostat trace v1"));
+#endif
 
-    // Сразу же выключаем нагреватель.
+    // Сразу же выключаем нагреватель и размыкаем отсекающее реле.
     turn_off();
+    cut_off();
+
+    // Запоминаем причину сброса. Без отключения питания кольцо событий
+    // сохранилось: это то, что происходило перед сбросом, и оно
+    // продолжается; после включения в нём мусор. Сброс сторожевым
+    // таймером или из-за просадки питания - тоже отказ: записываем его в
+    // журнал отказов и сохраняем кольцо.
+    reset_cause = MCUSR;
+    MCUSR = 0;
+    const bool ring_kept = !(reset_cause & (1 << PORF)) && event_magic == EVENT_MAGIC;
+    if (!ring_kept) {
+        memset(event_ring, 0, sizeof(event_ring));
+        event_head = 0;
+        event_magic = EVENT_MAGIC;
+    }
+    if (reset_cause & ((1 << WDRF) | (1 << BORF))) {
+        log_fault(NoPanic);
+        if (ring_kept)
+            save_postmortem(NoPanic);
+    }
+    record_event(EventBoot, reset_cause);
+
+    // Настраиваем термодатчик. Окончания преобразования не ждём,
+    // чтобы во время него опрашивать энкодер. Первое преобразование для
+    // самопроверки идёт, пока дисплей выдерживает паузы инициализации
+    // (при калибровке оно запускается заново после неё).
+    sensor.begin();
+    sensor.setWaitForConversion(false);
+    conversion_ms = sensor.millisToWaitForConversion(sensor.getResolution());
+    find_probes();
+    start_conversion();
 
-    // Настраиваем экран, выводим приветствие и пищим.
+    // Настраиваем экран.
     screen.init();
     screen.backlight();
-    clear_screen();
-    screen.print("Hello world!");
-    beep(250);
-
-    // Настраиваем термодатчик.
-    sensor.begin();
 
     // Настраиваем обработчик прерывания от таймера.
     // Подробнее см.: https://habr.com/ru/post/453276/
@@ -529,32 +2315,86 @@ void setup()
     // https://tsibrov.blogspot.com/2019/06/arduino-interrupts-part2.html
     PCICR |= (1 << PCIE1);
     PCMSK1 |= (1 << PC0);
+
+    // Если при включении нажата кнопка, калибруем вход энкодера/кнопок
+    // и спрашиваем, какие из датчиков на нагревателе и в комнате (для
+    // этого нужны прерывания от энкодера), иначе берём калибровку из
+    // EEPROM. Калибровка идёт до самопроверки: та длится до 45 с, и к её
+    // концу кнопку уже отпустили бы.
+    if (analogRead(USER_INPUT_PIN) >= INPUT_IDLE_LEVEL) {
+        calibrate_input();
+        mark_probes();
+        find_probes();
+        start_conversion();
+    } else {
+        load_calibration();
+    }
+
+    clear_screen();
+    screen.print(F("Self-test..."));
+
+    // Самопроверка, итог и звуковой сигнал готовности. Цикловые замеры
+    // (env:avrbench) идут без неё: в simavr датчик не греется, и
+    // самопроверка закончилась бы паникой "No heat.".
+#ifndef SKIP_SELF_TEST
+    self_test_failures = self_test();
+    show_self_test(self_test_failures);
+#endif
+    beep(250);
+
+    // Неисправный датчик или нагреватель - сразу паника, а не через час
+    // прогрева. С нестабильными показаниями сушка возможна: с ними
+    // справляется фильтр.
+    if (self_test_failures & SelfTestSensor)
+        panic(PanicSensorLost);
+    else if (self_test_failures & SelfTestHeater)
+        panic(PanicNoHeat);
 }
 
 void loop()
 {
-    uint8_t temp = 0;
+    if (panic_code != NoPanic) {
+        handle_panic();
+        return;
+    }
 
     // Если пластик ещё не выбран, показываем меню выбора.
     // Затем запускаем прогрев.
     if (filament == NULL) {
         turn_off();
+        cut_off();
+        set_backlight(true);
         choose_filament();
+        close_cutoff();
         clear_screen();
         reset_timer();
         heating_stage = Idle;
-        refresh_screen = true;
+        record_event(EventStage, Idle);
+        paused = false;
+        target_temp = filament->temp;
+        target_time_sec = filament->time_sec;
+        current_temp = 0;
+        filter_started = false;
+        observer_started = false;
+        cascade_integral = 0;
+        control_started = false;
+        off_periods = 0;
+        rh_count = 0;
+        start_conversion();
     }
 
     // Если идёт сушка и время подошло к концу, показываем сообщение,
     // пищим, ожидаем нажатия на энкодер/кнопку и снова показываем
     // меню выбора пластика.
-    if (heating_stage == Working && seconds > filament->time_sec) {
+    if (heating_stage == Working && seconds > target_time_sec) {
         turn_off();
+        cut_off();
 
+        // Подсветку могли выключить двойным щелчком.
+        set_backlight(true);
         clear_screen();
         screen.setCursor(0, 0);
-        screen.print("Finished!");
+        screen.print(F("Finished!"));
 
         beep(2000);
         delay(1000);
@@ -563,20 +2403,57 @@ void loop()
         beep(2000);
 
         screen.setCursor(0, 1);
-        screen.print("Press any key...");
+        screen.print(F("Press any key..."));
 
-        while (wait_for_action() != ActionConfirm)
-            ;
+        UserInputAction action = NoAction;
+        while (action != ActionConfirm && action != ActionLongPress && action != ActionDoubleClick)
+            action = wait_for_action();
 
         filament = NULL;
         return;
     }
 
-    temp = query_sensor();
-    set_heater_state(temp);
+    const UserInputAction action = poll_gesture();
+    if (action != NoAction)
+        record_event(EventInput, action);
+    process_action(action);
+    if (filament == NULL)
+        return;
+
+    // Когда термодатчик закончил преобразование, читаем температуру
+    // и сразу запускаем следующее. Нагревом управляем по оценке
+    // температуры камеры. На паузе нагрев не включаем, но температуру
+    // продолжаем проверять.
+    if (millis() - conversion_start >= conversion_ms) {
+        const unsigned long late = millis() - conversion_start - conversion_ms;
+        if (late >= OVERRUN_MS)
+            record_event(EventOverrun, constrain(late, 0UL, 255UL));
+        current_temp = query_sensor();
+        start_conversion();
+        if (panic_code != NoPanic)
+            return;
+        update_observer(filter_value, heater_is_on);
+        check_heater_runaway(filter_value);
+        // Если в течение часа так и не удалось прогреть сушилку
+        // до заданной температуры, значит что-то точно идёт не так.
+        if (heating_stage != Working && seconds >= PREHEAT_LIMIT_SEC)
+            panic(PanicPreheating);
+        if (panic_code != NoPanic)
+            return;
+        if (!paused) {
+            if (heater_probe)
+                update_cascade();
+            set_heater_state(observer_celsius());
+        }
+        track_humidity();
+    }
 
-    if (refresh_screen) {
+    if (refresh_screen && current_temp != 0 && millis() - last_input_time >= INPUT_REFRESH_DELAY) {
         refresh_screen = false;
-        update_screen(temp);
+        update_screen(current_temp);
     }
+    run_bus();
+
+    // Энкодер опрашивается примерно раз в миллисекунду.
+    delay(1);
 }
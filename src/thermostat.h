@@ -0,0 +1,246 @@
+// Общие определения прошивки сушилки.
+// Вынесены из main.cpp, чтобы сборка для хоста (env:native) могла
+// наблюдать за состоянием прошивки и управлять ею.
+#ifndef THERMOSTAT_H
+#define THERMOSTAT_H
+
+#include <Arduino.h>
+
+// Пин термодатчика.
+#define SENSOR_PIN (2)
+// Пин "пищалки".
+#define BEEPER_PIN (11)
+// Пин твердотельного реле управления нагревателем.
+#define HEATER_PIN (12)
+// Пин отсекающего реле, включённого последовательно с твердотельным
+// (механическое реле или цепь срабатывания термопредохранителя).
+// HIGH - цепь нагревателя замкнута, LOW - разомкнута.
+#define CUTOFF_PIN (10)
+// Пин сигналов от энкодера/кнопок.
+#define USER_INPUT_PIN (A0)
+// Адрес LCD-дисплея на шине I2C.
+#define LCD_ADDRESS (0x27)
+// Адрес необязательного датчика влажности SHT3x на той же шине.
+#define HUMIDITY_ADDRESS (0x44)
+
+// Второй, необязательный термодатчик на поверхности нагревателя
+// отмечен этим значением в пользовательских байтах TH, TL.
+#define HEATER_PROBE_MARK (0x4854)
+// Необязательный датчик в комнате (для упреждения по потерям, см.
+// control_heater()) отмечен этим значением.
+#define AMBIENT_PROBE_MARK (0x414D)
+// Предельная температура поверхности нагревателя, °C.
+#define HEATER_MAX_TEMP (100)
+// Прогрев, не закончившийся за столько секунд, - повод для паники.
+#define PREHEAT_LIMIT_SEC (3600)
+
+// Наблюдатель температуры камеры (см. update_observer()). Модель:
+// камера нагревается на OBSERVER_HEAT за период, если нагреватель был
+// включён OBSERVER_DEAD_PERIODS периодов назад, и меняется на
+// observer_drift (потери, влага) независимо от него; датчик догоняет
+// камеру с постоянной времени OBSERVER_SENSOR_TAU.
+// Период наблюдателя - время преобразования термодатчика (12 бит), мс.
+#define OBSERVER_PERIOD_MS (750)
+// Постоянная времени датчика вместе с фильтром показаний, с.
+#define OBSERVER_SENSOR_TAU (33.0)
+// Скорость нагрева камеры включённым нагревателем, °C/с.
+#define OBSERVER_HEAT_RATE (0.05)
+// Задержка от включения нагревателя до прихода тепла, периодов (до 15).
+#define OBSERVER_DEAD_PERIODS (7)
+// Состояние наблюдателя хранится в 1/128 °C, сдвинутых на
+// OBSERVER_SHIFT бит, коэффициенты - с OBSERVER_GAIN_SHIFT битами дробной
+// части.
+#define OBSERVER_SHIFT (8)
+#define OBSERVER_GAIN_SHIFT (12)
+#define OBSERVER_ONE (128L << OBSERVER_SHIFT)
+#define OBSERVER_LAG ((int32_t) ((1L << OBSERVER_GAIN_SHIFT) * OBSERVER_PERIOD_MS / 1000.0 / OBSERVER_SENSOR_TAU + 0.5))
+#define OBSERVER_HEAT ((int32_t) (OBSERVER_ONE * OBSERVER_HEAT_RATE * OBSERVER_PERIOD_MS / 1000.0 + 0.5))
+// Установившиеся коэффициенты фильтра Калмана для этой модели
+// (камера, датчик, дрейф). Пересчитываются на хосте: --observer.
+#define OBSERVER_GAIN_CHAMBER (7347)
+#define OBSERVER_GAIN_SENSOR (1026)
+#define OBSERVER_GAIN_DRIFT (35)
+
+// Действие, произведённое энкодером/кнопками.
+enum UserInputAction
+{
+    NoAction, // Бездействие.
+    ActionNext, // Вращение в одну сторону/Следующее значение.
+    ActionPrev, // Вращение в другую сторону/Предыдущее значение.
+    ActionConfirm, // Нажатие кнопки (подтверждение выбора).
+    ActionLongPress, // Длинное нажатие кнопки.
+    ActionDoubleClick, // Двойной щелчок кнопкой.
+    ActionShiftNext, // Вращение сразу после нажатия кнопки в одну сторону.
+    ActionShiftPrev, // Вращение сразу после нажатия кнопки в другую сторону.
+};
+
+// Стадия (состояние) сушки.
+enum HeatingStage
+{
+    Idle, // Выключено (бездействие).
+    PreHeating, // Прогрев.
+    Working, // Стабилизация температуры.
+};
+
+// Причина паники (см. panic()).
+enum PanicCode
+{
+    NoPanic, // Паники нет.
+    PanicSensorLost, // Термодатчик не отвечает.
+    PanicFrozen, // Температура ниже 2 °C.
+    PanicBurned, // Температура 120 °C и выше.
+    PanicHeaterState, // Управление нагревом без выбранного пластика.
+    PanicPreheating, // Прогрев не закончился за час.
+    PanicHeaterStuck, // Температура растёт при выключенном нагревателе.
+    PanicNoHeat, // Самопроверка: импульс нагрева не дал роста температуры.
+};
+
+// Неисправности, найденные самопроверкой при включении (биты).
+enum SelfTestFailure
+{
+    SelfTestSensor = 1, // Датчик камеры не отвечает, CRC или показание неверны.
+    SelfTestUnstable = 2, // Два показания подряд сильно различаются.
+    SelfTestHeater = 4, // Нагрев не дал роста температуры.
+    SelfTestDisplay = 8, // Дисплей не отвечает на своём адресе I2C.
+};
+
+// Журнал отказов в EEPROM: кольцо из FAULT_LOG_SIZE записей после
+// калибровки входа. Новая запись пишется в ячейку за самой свежей,
+// порядок восстанавливается по номерам записей.
+#define FAULT_LOG_ADDRESS (32)
+#define FAULT_LOG_SIZE (16)
+
+// Запись журнала отказов: паника или необычный сброс (code == NoPanic,
+// сторожевой таймер или просадка питания).
+typedef struct
+{
+    uint8_t sequence; // Номер записи (по модулю 256).
+    uint8_t code; // PanicCode.
+    uint8_t stage; // HeatingStage.
+    uint8_t reset_cause; // MCUSR при последнем запуске.
+    uint16_t minutes; // Сколько минут шла стадия.
+    int16_t sensor; // Отфильтрованное показание датчика, 1/128 °C.
+    int16_t estimate; // Оценка температуры камеры, 1/128 °C.
+    uint8_t target; // Уставка, °C.
+    uint8_t crc; // CRC-8 предыдущих полей.
+} FaultRecord;
+
+// Журнал событий перед отказом: кольцо последних POSTMORTEM_EVENTS
+// событий в ОЗУ, которое переживает сброс без отключения питания. При
+// панике или после такого сброса оно сохраняется в EEPROM по адресу
+// POSTMORTEM_ADDRESS (за журналом отказов). Время событий - millis() в
+// единицах 2^POSTMORTEM_TICK_SHIFT мс, младшие 16 бит.
+#define POSTMORTEM_ADDRESS (FAULT_LOG_ADDRESS + FAULT_LOG_SIZE * sizeof(FaultRecord))
+#define POSTMORTEM_EVENTS (32)
+#define POSTMORTEM_TICK_SHIFT (6)
+#define POSTMORTEM_VERSION (1)
+
+// Вид события.
+enum EventKind
+{
+    EventNone, // Пустая запись кольца.
+    EventBoot, // Запуск, данные - MCUSR.
+    EventStage, // Смена стадии, данные - HeatingStage.
+    EventHeater, // Нагреватель включён (1) или выключен (0).
+    EventSensorError, // Ошибка датчика, данные - SensorError.
+    EventInput, // Жест энкодера/кнопок, данные - UserInputAction.
+    EventOverrun, // Чтение датчика опоздало, данные - на сколько, мс (до 255).
+    EventPanic, // Паника, данные - PanicCode.
+};
+
+// Ошибки датчиков для EventSensorError.
+enum SensorError
+{
+    SensorNoAnswer, // Датчик камеры не ответил или CRC неверна.
+    SensorRejected, // Фильтр отбросил невозможное показание.
+    SensorAuxLost, // Дополнительный датчик не ответил.
+    SensorHumidityLost, // Датчик влажности не отвечает, сушка - по времени.
+};
+
+typedef struct
+{
+    uint16_t time; // Время, 2^POSTMORTEM_TICK_SHIFT мс.
+    uint8_t kind; // EventKind.
+    uint8_t data;
+} PostMortemEvent;
+
+// Сохранённое кольцо событий.
+typedef struct
+{
+    uint8_t version; // POSTMORTEM_VERSION.
+    uint8_t reason; // PanicCode или NoPanic, если сохранено после сброса.
+    uint8_t reset_cause; // MCUSR при запуске, во время которого записаны события.
+    uint8_t head; // Ячейка, куда пошло бы следующее событие (самая старая).
+    PostMortemEvent events[POSTMORTEM_EVENTS];
+    uint8_t crc; // CRC-8 предыдущих полей.
+} PostMortem;
+
+// Описание настроек пластика.
+typedef struct
+{
+    const char *const name; // Название.
+    const uint8_t temp; // Температура сушки.
+    const unsigned long time_sec; // Время сушки, с.
+    // Влажность в камере, %, ниже которой сушка заканчивается раньше
+    // time_sec, когда влажность перестала падать (0 - только по времени).
+    const uint8_t dry_rh;
+} Filament;
+
+// Таблица с настройками для разных видов пластика.
+extern const Filament filaments[];
+extern const uint8_t filaments_count;
+
+// Выбранный пластик.
+extern volatile const Filament *filament;
+// Флаг, показывающий что пора обновить значения на дисплее.
+extern volatile bool refresh_screen;
+// Счётчик секунд, прошедших с момента запуска текущей стадии.
+extern volatile unsigned long seconds;
+// Флаг, показывающий включен сейчас нагрев или выключен.
+extern volatile bool heater_is_on;
+// Флаг, показывающий что есть событие от энкодера/кнопок.
+extern volatile bool input_event_occurred;
+// Текущая стадия сушки.
+extern volatile HeatingStage heating_stage;
+// Флаг паузы: нагрев выключен, счётчик секунд остановлен.
+extern volatile bool paused;
+// Температура и время сушки с учётом изменений во время работы.
+extern uint8_t target_temp;
+extern unsigned long target_time_sec;
+// Оценки наблюдателя: температура камеры и датчика и дрейф камеры за
+// период (единицы см. OBSERVER_SHIFT).
+extern int32_t observer_chamber;
+extern int32_t observer_sensor;
+extern int32_t observer_drift;
+// Причина паники и её сообщение (NULL, если паники нет). Сообщение
+// лежит во флеш-памяти; на хосте его можно читать как обычную строку.
+extern volatile PanicCode panic_code;
+extern const char *volatile panic_reason;
+// Сообщения для кодов паники (PROGMEM).
+extern const char *const panic_messages[];
+// Итог самопроверки при включении (биты SelfTestFailure).
+extern uint8_t self_test_failures;
+// Датчик влажности отвечает, и влажность в камере, 1/100 %.
+extern bool humidity_sensor;
+extern uint16_t chamber_rh;
+extern bool humidity_valid;
+
+void setup();
+void loop();
+
+// Функции прошивки, которые вызывают стенды (sim/, bench/).
+int16_t filter_temperature(const int16_t raw);
+void update_observer(const int16_t measured, const bool heating);
+uint8_t query_sensor(void);
+void update_screen(const uint8_t temp);
+void clear_screen(void);
+void flush_frame(uint8_t limit);
+void run_bus(void);
+void load_calibration(void);
+UserInputAction poll_action(void);
+UserInputAction poll_gesture(void);
+UserInputAction wait_for_action(void);
+bool read_fault(const uint8_t age, FaultRecord *const record);
+bool read_postmortem(PostMortem *const record);
+
+#endif // THERMOSTAT_H